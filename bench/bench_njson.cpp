@@ -0,0 +1,748 @@
+/*
+ * Copyright (c) 2023 SK Telecom Co., Ltd. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Timings of the faster paths of njson next to the plain ones they replace.
+// Runs the cases named on the command line, or all of them.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef BENCH_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "njson/njson.h"
+
+struct Record {
+    int id;
+    std::string name;
+    double ratio;
+    bool online;
+    std::vector<std::string> tags;
+};
+
+struct Records {
+    std::vector<Record> records;
+};
+
+namespace NJson {
+template <>
+struct Binding<Record> {
+    template <typename Fields>
+    static void fields(Fields& f)
+    {
+        f("id", &Record::id);
+        f("name", &Record::name);
+        f("ratio", &Record::ratio);
+        f("online", &Record::online);
+        f("tags", &Record::tags);
+    }
+};
+
+template <>
+struct Binding<Records> {
+    template <typename Fields>
+    static void fields(Fields& f)
+    {
+        f("records", &Records::records);
+    }
+};
+}
+
+namespace {
+
+// keeps the compiler from dropping the results
+volatile size_t sink;
+
+// average time of one call of work
+void measure(const char* label, int iterations, const std::function<void()>& work)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; i++)
+        work();
+
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("  %-44s %12.3f us\n", label, elapsed.count() / iterations);
+}
+
+// {"records":[{"id":0,"name":"device-0","ratio":0.5,"online":true,"tags":["a","b"]},...]}
+std::string makeRecords(int count)
+{
+    std::string data = "{\"records\":[";
+
+    for (int i = 0; i < count; i++) {
+        if (i)
+            data += ",";
+
+        data += "{\"id\":" + std::to_string(i) + ",\"name\":\"device-" + std::to_string(i)
+            + "\",\"ratio\":" + std::to_string(i) + ".5,\"online\":" + (i % 2 ? "true" : "false")
+            + ",\"tags\":[\"a\",\"b\"]}";
+    }
+
+    return data + "]}";
+}
+
+NJson::Value parse(const std::string& data)
+{
+    NJson::Reader reader;
+    NJson::Value value;
+
+    reader.parse(data, value);
+
+    return value;
+}
+
+void benchPath()
+{
+    NJson::Value root = parse(makeRecords(1000));
+    NJson::Path compiled("/records/500/name");
+    NJson::Path expression("records[*].id");
+
+    measure("operator[] chain", 1000000, [&]() {
+        sink = root["records"][500]["name"].asString().size();
+    });
+    measure("compiled JSON Pointer", 1000000, [&]() {
+        sink = compiled.resolve(root).asString().size();
+    });
+    measure("JSON Pointer compiled on each call", 1000000, [&]() {
+        sink = NJson::Path("/records/500/name").resolve(root).asString().size();
+    });
+    measure("operator[] loop over 1000 ids", 2000, [&]() {
+        NJson::Value records = root["records"];
+        size_t total = 0;
+
+        for (NJson::ArrayIndex i = 0; i < records.size(); i++)
+            total += records[i]["id"].asInt();
+        sink = total;
+    });
+    measure("path expression over 1000 ids", 2000, [&]() {
+        size_t total = 0;
+
+        for (const auto& id : expression.select(root))
+            total += id.asInt();
+        sink = total;
+    });
+}
+
+void benchBinding()
+{
+    std::string data = makeRecords(10000);
+
+    measure("parse into Value, copy members out", 20, [&]() {
+        NJson::Value root = parse(data);
+        NJson::Value records = root["records"];
+        Records parsed;
+
+        parsed.records.resize(records.size());
+        for (NJson::ArrayIndex i = 0; i < records.size(); i++) {
+            NJson::Value record = records[i];
+            Record& target = parsed.records[i];
+
+            target.id = record["id"].asInt();
+            target.name = record["name"].asString();
+            target.ratio = record["ratio"].asDouble();
+            target.online = record["online"].asBool();
+            for (NJson::ArrayIndex j = 0; j < record["tags"].size(); j++)
+                target.tags.push_back(record["tags"][j].asString());
+        }
+        sink = parsed.records.size();
+    });
+    measure("readStruct", 20, [&]() {
+        Records parsed;
+
+        NJson::readStruct(data, parsed);
+        sink = parsed.records.size();
+    });
+
+    Records records;
+    NJson::readStruct(data, records);
+
+    measure("build Value, FastWriter", 20, [&]() {
+        NJson::Value root;
+        NJson::Value array = root["records"];
+
+        for (const auto& record : records.records) {
+            NJson::Value item;
+
+            item["id"] = record.id;
+            item["name"] = record.name;
+            item["ratio"] = record.ratio;
+            item["online"] = record.online;
+            for (const auto& tag : record.tags)
+                item["tags"].append(tag);
+            array.append(item);
+        }
+        sink = NJson::FastWriter().write(root).size();
+    });
+    measure("writeStruct", 20, [&]() {
+        sink = NJson::writeStruct(records).size();
+    });
+}
+
+// only the ids of the records are kept
+void benchProjection()
+{
+    std::string data = makeRecords(50000);
+    NJson::Reader reader;
+    std::vector<NJson::Path> projection { "records[*].id" };
+
+    measure("Reader, full tree", 20, [&]() {
+        NJson::Value value;
+
+        reader.parse(data, value);
+        sink = value["records"].size();
+    });
+    measure("Reader with projection", 20, [&]() {
+        NJson::Value value;
+
+        reader.parse(data, value, projection);
+        sink = value["records"].size();
+    });
+}
+
+// 100000 fractions, parsed and written in each number mode
+void benchNumbers()
+{
+    std::string data = "[";
+
+    for (int i = 0; i < 100000; i++)
+        data += (i ? "," : "") + std::to_string(i * 0.37 + 0.001);
+    data += "]";
+
+    const struct {
+        const char* name;
+        NJson::NumberMode mode;
+    } modes[] = {
+        { "defaultNumber", NJson::NumberMode::defaultNumber },
+        { "fullPrecisionNumber", NJson::NumberMode::fullPrecisionNumber },
+        { "rawNumber", NJson::NumberMode::rawNumber },
+    };
+    NJson::FastWriter writer;
+
+    for (const auto& mode : modes) {
+        NJson::Reader reader(mode.mode);
+        NJson::Value value;
+        std::string label = std::string("parse, ") + mode.name;
+
+        measure(label.c_str(), 20, [&]() {
+            reader.parse(data, value);
+            sink = value.size();
+        });
+        label = std::string("write, ") + mode.name;
+        measure(label.c_str(), 20, [&]() {
+            sink = writer.write(value).size();
+        });
+    }
+
+    NJson::Value floats;
+    measure("assign 100000 floats", 20, [&]() {
+        for (NJson::ArrayIndex i = 0; i < 100000; i++)
+            floats[i] = i * 0.37f + 0.001f;
+    });
+    measure("write floats, shortest", 20, [&]() {
+        sink = writer.write(floats).size();
+    });
+    writer.setMaxDecimalPlaces(3);
+    measure("write floats, 3 decimal places", 20, [&]() {
+        sink = writer.write(floats).size();
+    });
+}
+
+// names of the records compared without copying them out
+void benchStringView()
+{
+    NJson::Value root = parse(makeRecords(50000));
+    NJson::Value records = root["records"];
+
+    measure("asString() over 50000 names", 20, [&]() {
+        size_t total = 0;
+
+        for (NJson::ArrayIndex i = 0; i < records.size(); i++)
+            total += records[i]["name"].asString() == "device-7";
+        sink = total;
+    });
+    measure("asStringView() over 50000 names", 20, [&]() {
+        size_t total = 0;
+
+        for (NJson::ArrayIndex i = 0; i < records.size(); i++)
+            total += records[i]["name"].asStringView() == "device-7";
+        sink = total;
+    });
+}
+
+// 1% of the records change between two writes
+void benchCachedWrite()
+{
+    std::string data = makeRecords(50000);
+    NJson::Value plain = parse(data);
+    NJson::Value tracked = parse(data);
+    NJson::FastWriter writer;
+    int round = 0;
+
+    tracked.trackChanges();
+    sink = writer.write(tracked).size();
+
+    auto change = [&round](NJson::Value& root) {
+        NJson::Value records = root["records"];
+
+        for (NJson::ArrayIndex i = round % 100; i < records.size(); i += 100)
+            records[i]["ratio"] = round;
+    };
+
+    measure("FastWriter", 20, [&]() {
+        change(plain);
+        sink = writer.write(plain).size();
+        round++;
+    });
+    measure("FastWriter with trackChanges()", 20, [&]() {
+        change(tracked);
+        sink = writer.write(tracked).size();
+        round++;
+    });
+}
+
+// 1% of the records changed, sent as a JSON Patch or as the whole document
+void benchPatch()
+{
+    std::string data = makeRecords(10000);
+    NJson::Value original = parse(data);
+    NJson::Value modified = parse(data);
+    NJson::Value records = modified["records"];
+    NJson::FastWriter writer;
+
+    for (NJson::ArrayIndex i = 0; i < records.size(); i += 100)
+        records[i]["ratio"] = 0.25;
+
+    std::string document = writer.write(modified);
+    NJson::Value patch;
+
+    measure("diffJsonPatch", 20, [&]() {
+        patch = NJson::diffJsonPatch(original, modified);
+    });
+
+    std::string text = writer.write(patch);
+    printf("  %-44s %12zu bytes\n", "document", document.size());
+    printf("  %-44s %12zu bytes\n", "patch", text.size());
+
+    measure("parse the document", 20, [&]() {
+        sink = parse(document).size();
+    });
+
+    NJson::Value target = parse(data);
+    measure("parse and apply the patch", 20, [&]() {
+        sink = NJson::applyJsonPatch(target, parse(text));
+    });
+
+    NJson::Value replace = parse(R"([{"op":"replace","path":"/records/5000/name","value":"renamed"}])");
+    measure("apply a one operation patch", 300, [&]() {
+        sink = NJson::applyJsonPatch(target, replace);
+    });
+}
+
+// two equal documents compared, and hashed again and again
+void benchHash()
+{
+    std::string data = makeRecords(10000);
+    NJson::Value first = parse(data);
+    NJson::Value second = parse(data);
+    NJson::Value tracked = parse(data);
+    NJson::FastWriter writer;
+
+    measure("compare FastWriter output", 20, [&]() {
+        sink = writer.write(first) == writer.write(second);
+    });
+    measure("operator==", 20, [&]() {
+        sink = first == second;
+    });
+    measure("hash()", 20, [&]() {
+        sink = first.hash();
+    });
+
+    tracked.trackChanges();
+    tracked.hash();
+    measure("hash() with trackChanges(), cached", 20, [&]() {
+        sink = tracked.hash();
+    });
+}
+
+void benchParallelWrite()
+{
+    NJson::Value root = parse(makeRecords(50000));
+    NJson::FastWriter writer;
+
+    measure("FastWriter", 20, [&]() {
+        sink = writer.write(root).size();
+    });
+    for (unsigned int threads : { 1, 2, 4 }) {
+        NJson::ParallelWriter parallel_writer(threads);
+        std::string label = "ParallelWriter(" + std::to_string(threads) + ")";
+
+        measure(label.c_str(), 20, [&]() {
+            sink = parallel_writer.write(root).size();
+        });
+    }
+}
+
+void benchParallelRead()
+{
+    std::string records = makeRecords(50000);
+    // the array alone, only a top level array is split
+    std::string data = records.substr(records.find('['), records.size() - records.find('[') - 1);
+    NJson::Reader reader;
+
+    measure("Reader", 20, [&]() {
+        NJson::Value value;
+
+        reader.parse(data, value);
+        sink = value.size();
+    });
+    for (unsigned int threads : { 1, 2, 4 }) {
+        NJson::ParallelReader parallel_reader(threads);
+        std::string label = "ParallelReader(" + std::to_string(threads) + ")";
+
+        measure(label.c_str(), 20, [&]() {
+            NJson::Value value;
+
+            parallel_reader.parse(data, value);
+            sink = value.size();
+        });
+    }
+}
+
+// many small documents with the same long keys and values, all kept
+void benchIntern()
+{
+    const std::string document = R"({"device_identifier":"speaker-living-room","measurement_timestamp":1700000000,)"
+                                 R"("firmware_version":"1.2.3-release-candidate","connection_status":"online"})";
+    std::vector<NJson::Value> values(10000);
+    NJson::Reader reader;
+
+    measure("Reader, 10000 documents", 10, [&]() {
+        for (auto& value : values)
+            reader.parse(document, value);
+    });
+
+    NJson::InternTable intern_table(32);
+    reader.setInternTable(intern_table);
+    values.assign(values.size(), NJson::Value());
+
+    measure("Reader with InternTable, 10000 documents", 10, [&]() {
+        for (auto& value : values)
+            reader.parse(document, value);
+    });
+
+    NJson::InternTable::Stats stats = intern_table.getStats();
+    printf("  %-44s %12zu bytes\n", "stored once", stats.stored_bytes);
+    printf("  %-44s %12zu bytes\n", "saved over 10 rounds", stats.saved_bytes);
+}
+
+// an array of 1000000 numbers built from a vector
+void benchBulk()
+{
+    std::vector<double> numbers;
+
+    for (int i = 0; i < 1000000; i++)
+        numbers.push_back(i * 0.5);
+
+    measure("operator[] by index", 5, [&]() {
+        NJson::Value array;
+
+        for (NJson::ArrayIndex i = 0; i < numbers.size(); i++)
+            array[i] = numbers[i];
+        sink = array.size();
+    });
+    measure("reserve(), then append()", 5, [&]() {
+        NJson::Value array(NJson::ValueType::arrayValue);
+
+        array.reserve(static_cast<NJson::ArrayIndex>(numbers.size()));
+        for (double number : numbers)
+            array.append(NJson::Value(number));
+        sink = array.size();
+    });
+    measure("Value(const std::vector<double>&)", 5, [&]() {
+        NJson::Value array(numbers);
+
+        sink = array.size();
+    });
+}
+
+// an array of 1000000 numbers read into a std::vector<double>
+void benchNumberArrays()
+{
+    std::string data = "[";
+
+    for (int i = 0; i < 1000000; i++)
+        data += (i ? "," : "") + std::to_string(i) + ".5";
+    data += "]";
+
+    NJson::Reader reader;
+    NJson::Value array = parse(data);
+
+    measure("parse, then asDouble() per element", 5, [&]() {
+        NJson::Value value = parse(data);
+        std::vector<double> numbers;
+
+        numbers.reserve(value.size());
+        for (NJson::ArrayIndex i = 0; i < value.size(); i++)
+            numbers.push_back(value[i].asDouble());
+        sink = numbers.size();
+    });
+    measure("Reader::parse into the vector", 5, [&]() {
+        std::vector<double> numbers;
+
+        reader.parse(data, numbers);
+        sink = numbers.size();
+    });
+    measure("asDouble() per element of a parsed tree", 5, [&]() {
+        std::vector<double> numbers;
+
+        numbers.reserve(array.size());
+        for (NJson::ArrayIndex i = 0; i < array.size(); i++)
+            numbers.push_back(array[i].asDouble());
+        sink = numbers.size();
+    });
+    measure("getNumbers() of a parsed tree", 5, [&]() {
+        std::vector<double> numbers;
+
+        array.getNumbers(numbers);
+        sink = numbers.size();
+    });
+}
+
+void benchColumns()
+{
+    NJson::Value root = parse(makeRecords(50000));
+    NJson::Value records = root["records"];
+
+    measure("operator[] loop into vectors", 20, [&]() {
+        std::vector<long long> ids;
+        std::vector<double> ratios;
+        std::vector<std::string> names;
+
+        for (NJson::ArrayIndex i = 0; i < records.size(); i++) {
+            NJson::Value record = records[i];
+
+            ids.push_back(record["id"].asLargestInt());
+            ratios.push_back(record["ratio"].asDouble());
+            names.push_back(record["name"].asString());
+        }
+        sink = ids.size() + ratios.size() + names.size();
+    });
+
+    NJson::ColumnExtractor extractor;
+    extractor.addInteger("id");
+    extractor.addDouble("ratio");
+    extractor.addString("name");
+
+    measure("ColumnExtractor::extract", 20, [&]() {
+        extractor.extract(records);
+        sink = extractor.getRows();
+    });
+}
+
+// the same 10000 records written through a Value or straight to the output
+void benchBuilder()
+{
+    Records records;
+    NJson::readStruct(makeRecords(10000), records);
+
+    measure("build Value, FastWriter", 20, [&]() {
+        NJson::Value root;
+        NJson::Value array = root["records"];
+
+        for (const auto& record : records.records) {
+            NJson::Value item;
+
+            item["id"] = record.id;
+            item["name"] = record.name;
+            item["ratio"] = record.ratio;
+            item["online"] = record.online;
+            for (const auto& tag : record.tags)
+                item["tags"].append(tag);
+            array.append(item);
+        }
+        sink = NJson::FastWriter().write(root).size();
+    });
+    measure("Builder", 20, [&]() {
+        NJson::Builder builder;
+        {
+            NJson::Builder::ObjectScope root(builder);
+            NJson::Builder::ArrayScope array(builder, "records");
+
+            for (const auto& record : records.records) {
+                NJson::Builder::ObjectScope item(builder);
+
+                builder.key("id").value(record.id);
+                builder.key("name").value(record.name);
+                builder.key("ratio").value(record.ratio);
+                builder.key("online").value(record.online);
+
+                NJson::Builder::ArrayScope tags(builder, "tags");
+                for (const auto& tag : record.tags)
+                    builder.value(tag);
+            }
+        }
+        sink = builder.getString().size();
+    });
+}
+
+#ifdef BENCH_WITH_ZLIB
+// the whole gzip input decompressed at once, as done before parsing streams
+std::string gunzip(const std::string& data)
+{
+    std::string output;
+    char chunk[64 * 1024];
+    z_stream stream {};
+
+    // 32 lets zlib take the gzip header
+    inflateInit2(&stream, 15 + 32);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+
+    int result = Z_OK;
+    while (result == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef*>(chunk);
+        stream.avail_out = sizeof(chunk);
+        result = inflate(&stream, Z_NO_FLUSH);
+        output.append(chunk, sizeof(chunk) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+
+    return output;
+}
+#endif
+
+// 50000 records written and read as plain and gzip streams
+void benchCompression()
+{
+    NJson::Value root = parse(makeRecords(50000));
+    NJson::FastWriter writer;
+    NJson::Reader reader;
+    std::string plain;
+    std::string gzip;
+
+    measure("write, plain stream", 5, [&]() {
+        std::ostringstream output;
+
+        writer.write(root, output);
+        plain = output.str();
+    });
+
+    if (!NJson::isCompressionSupported(NJson::gzipCompression)) {
+        printf("  %-44s\n", "gzip is not supported by this build");
+        return;
+    }
+
+    measure("write, gzip stream", 5, [&]() {
+        std::ostringstream output;
+
+        writer.write(root, output, NJson::gzipCompression);
+        gzip = output.str();
+    });
+    printf("  %-44s %12zu bytes\n", "plain", plain.size());
+    printf("  %-44s %12zu bytes\n", "gzip", gzip.size());
+
+    measure("parse, plain stream", 5, [&]() {
+        std::istringstream input(plain);
+        NJson::Value value;
+
+        reader.parse(input, value);
+        sink = value.size();
+    });
+    measure("parse, gzip stream", 5, [&]() {
+        std::istringstream input(gzip);
+        NJson::Value value;
+
+        reader.parse(input, value);
+        sink = value.size();
+    });
+#ifdef BENCH_WITH_ZLIB
+    measure("decompress, then parse the string", 5, [&]() {
+        NJson::Value value;
+
+        reader.parse(gunzip(gzip), value);
+        sink = value.size();
+    });
+#endif
+}
+
+// accessors are only inlined by bench_njson_header_only, compare both builds
+void benchReadLoop()
+{
+    NJson::Value root = parse(makeRecords(50000));
+    NJson::Value records = root["records"];
+
+    measure("accessor loop over 50000 records", 20, [&]() {
+        size_t total = 0;
+
+        for (NJson::ArrayIndex i = 0; i < records.size(); i++) {
+            NJson::Value record = records[i];
+
+            if (!record.isObject() || !record["online"].asBool())
+                continue;
+
+            total += record["id"].asInt() + static_cast<size_t>(record["ratio"].asDouble()) + record["tags"].size();
+        }
+        sink = total;
+    });
+}
+
+struct Case {
+    const char* name;
+    void (*run)();
+};
+
+const Case cases[] = {
+    { "path", benchPath },
+    { "binding", benchBinding },
+    { "projection", benchProjection },
+    { "numbers", benchNumbers },
+    { "string_view", benchStringView },
+    { "cached_write", benchCachedWrite },
+    { "patch", benchPatch },
+    { "hash", benchHash },
+    { "parallel_write", benchParallelWrite },
+    { "parallel_read", benchParallelRead },
+    { "intern", benchIntern },
+    { "bulk", benchBulk },
+    { "number_arrays", benchNumberArrays },
+    { "columns", benchColumns },
+    { "builder", benchBuilder },
+    { "compression", benchCompression },
+    { "read_loop", benchReadLoop },
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    for (const auto& bench : cases) {
+        if (argc > 1 && std::find(argv + 1, argv + argc, std::string(bench.name)) == argv + argc)
+            continue;
+
+        printf("%s\n", bench.name);
+        bench.run();
+    }
+
+    return 0;
+}
@@ -0,0 +1,4832 @@
+/*
+ * Copyright (c) 2023 SK Telecom Co., Ltd. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NJSON_INL_H__
+#define __NJSON_INL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <rapidjson/document.h>
+#include <rapidjson/memorystream.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/reader.h>
+#include <rapidjson/stringbuffer.h>
+
+#ifdef NJSON_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef NJSON_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "njson.h"
+
+// helpers of the library, shared by the translation units including it in
+// header only mode
+#ifdef NJSON_HEADER_ONLY
+#define NJSON_LOCAL inline
+#else
+#define NJSON_LOCAL static
+#endif
+
+namespace NJson {
+NJSON_BEGIN_CONFIG
+using NativeValue = rapidjson::Value;
+using NativeValueIterator = rapidjson::Value::ValueIterator;
+using NativeAllocator = rapidjson::MemoryPoolAllocator<>;
+
+// texts of the numbers parsed with NumberMode::rawNumber. The tree refers to
+// them as strings, which are told apart from string values by their address
+class RawNumbers {
+public:
+    RawNumbers()
+        : position(nullptr)
+        , left(0)
+    {
+    }
+
+    StringView add(const char* text, size_t length)
+    {
+        const size_t block_size = 16 * 1024;
+
+        if (length + 1 > left) {
+            size_t size = std::max(length + 1, block_size);
+
+            blocks.emplace_back(new char[size]);
+            position = blocks.back().get();
+            left = size;
+            ranges[position] = position + size;
+        }
+
+        char* copied = position;
+
+        memcpy(copied, text, length);
+        copied[length] = '\0';
+        position += length + 1;
+        left -= length + 1;
+
+        return StringView(copied, length);
+    }
+
+    bool contains(const char* text) const
+    {
+        auto range = ranges.upper_bound(text);
+
+        return range != ranges.begin() && std::less<const char*>()(text, (--range)->second);
+    }
+
+    bool contains(const NativeValue& node) const
+    {
+        return node.IsString() && contains(node.GetString());
+    }
+
+    // takes over the texts of other, parsed by another thread
+    void merge(RawNumbers& other)
+    {
+        for (auto& block : other.blocks)
+            blocks.push_back(std::move(block));
+
+        ranges.insert(other.ranges.begin(), other.ranges.end());
+        other.blocks.clear();
+        other.ranges.clear();
+        other.position = nullptr;
+        other.left = 0;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::map<const char*, const char*> ranges;
+    char* position;
+    size_t left;
+};
+
+// passes the numbers kept as text to handler as numbers
+template <typename Handler>
+class RawNumberHandler {
+public:
+    RawNumberHandler(Handler& handler, const RawNumbers& raw_numbers)
+        : handler(handler)
+        , raw_numbers(raw_numbers)
+    {
+    }
+
+    bool Null() { return handler.Null(); }
+    bool Bool(bool value) { return handler.Bool(value); }
+    bool Int(int value) { return handler.Int(value); }
+    bool Uint(unsigned int value) { return handler.Uint(value); }
+    bool Int64(int64_t value) { return handler.Int64(value); }
+    bool Uint64(uint64_t value) { return handler.Uint64(value); }
+    bool Double(double value) { return handler.Double(value); }
+    bool StartObject() { return handler.StartObject(); }
+    bool Key(const char* name, rapidjson::SizeType length, bool copy) { return handler.Key(name, length, copy); }
+    bool EndObject(rapidjson::SizeType count) { return handler.EndObject(count); }
+    bool StartArray() { return handler.StartArray(); }
+    bool EndArray(rapidjson::SizeType count) { return handler.EndArray(count); }
+
+    bool String(const char* value, rapidjson::SizeType length, bool copy)
+    {
+        if (raw_numbers.contains(value))
+            return handler.RawValue(value, length, rapidjson::kNumberType);
+
+        return handler.String(value, length, copy);
+    }
+
+private:
+    Handler& handler;
+    const RawNumbers& raw_numbers;
+};
+
+template <typename Handler>
+bool acceptValue(const NativeValue& node, Handler& handler, const RawNumbers* raw_numbers)
+{
+    if (!raw_numbers)
+        return node.Accept(handler);
+
+    RawNumberHandler<Handler> raw_handler(handler, *raw_numbers);
+
+    return node.Accept(raw_handler);
+}
+
+template <typename T>
+std::string stringify(const NativeValue* native_value, int max_decimal_places = -1, const RawNumbers* raw_numbers = nullptr)
+{
+    if (!native_value)
+        return "";
+
+    rapidjson::StringBuffer buffer;
+
+    T writer(buffer);
+    if (max_decimal_places >= 0)
+        writer.SetMaxDecimalPlaces(max_decimal_places);
+    acceptValue(*native_value, writer, raw_numbers);
+
+    return buffer.GetString();
+}
+
+template <typename InputStream, typename Handler>
+bool parseStreamWith(InputStream& input_stream, Handler& handler, NumberMode number_mode)
+{
+    rapidjson::Reader reader;
+
+    switch (number_mode) {
+    case NumberMode::fullPrecisionNumber:
+        return !reader.Parse<rapidjson::kParseFullPrecisionFlag>(input_stream, handler).IsError();
+    case NumberMode::rawNumber:
+        return !reader.Parse<rapidjson::kParseNumbersAsStringsFlag>(input_stream, handler).IsError();
+    default:
+        return !reader.Parse(input_stream, handler).IsError();
+    }
+}
+
+template <typename Handler>
+bool parseWith(const std::string& data, Handler& handler, NumberMode number_mode)
+{
+    rapidjson::StringStream input_stream(data.c_str());
+
+    return parseStreamWith(input_stream, handler, number_mode);
+}
+
+template <typename InputStream>
+void parseDocument(rapidjson::Document& document, InputStream& input_stream, NumberMode number_mode)
+{
+    switch (number_mode) {
+    case NumberMode::fullPrecisionNumber:
+        document.ParseStream<rapidjson::kParseFullPrecisionFlag>(input_stream);
+        break;
+    case NumberMode::rawNumber:
+        document.ParseStream<rapidjson::kParseNumbersAsStringsFlag>(input_stream);
+        break;
+    default:
+        document.ParseStream(input_stream);
+        break;
+    }
+}
+
+// refers to str without copying
+NJSON_LOCAL NativeValue toNativeString(StringView str)
+{
+    return NativeValue(rapidjson::StringRef(str.data() ? str.data() : "", str.size()));
+}
+
+// looks at the same position first since objects being compared usually keep
+// their members in the same order, FindMember() alone makes it quadratic
+NJSON_LOCAL NativeValue::ConstMemberIterator findMemberAt(const NativeValue& object, const NativeValue& name, rapidjson::SizeType index)
+{
+    if (index < object.MemberCount()) {
+        auto member = object.MemberBegin() + index;
+
+        if (member->name == name)
+            return member;
+    }
+
+    return object.FindMember(name);
+}
+
+// MemberReserve() is missing in some releases of RapidJSON
+template <typename T>
+auto reserveMembers(T& object, rapidjson::SizeType size, NativeAllocator& allocator, int)
+    -> decltype(object.MemberReserve(size, allocator), void())
+{
+    object.MemberReserve(size, allocator);
+}
+
+template <typename T>
+void reserveMembers(T&, rapidjson::SizeType, NativeAllocator&, long)
+{
+}
+
+NJSON_LOCAL NativeValue toNativeValue(int value, NativeAllocator&)
+{
+    return NativeValue(value);
+}
+
+NJSON_LOCAL NativeValue toNativeValue(unsigned int value, NativeAllocator&)
+{
+    return NativeValue(value);
+}
+
+NJSON_LOCAL NativeValue toNativeValue(long long value, NativeAllocator&)
+{
+    return NativeValue(static_cast<int64_t>(value));
+}
+
+NJSON_LOCAL NativeValue toNativeValue(double value, NativeAllocator&)
+{
+    return NativeValue(value);
+}
+
+NJSON_LOCAL NativeValue toNativeValue(const std::string& value, NativeAllocator& allocator)
+{
+    return NativeValue(value.data(), value.size(), allocator);
+}
+
+// fills array in one pass without a temporary Value for each element
+template <typename T>
+void fillArray(NativeValue& array, const T* first, const T* last, NativeAllocator& allocator)
+{
+    array.SetArray();
+    array.Reserve(static_cast<rapidjson::SizeType>(last - first), allocator);
+
+    for (; first != last; ++first)
+        array.PushBack(toNativeValue(*first, allocator), allocator);
+}
+
+NJSON_LOCAL void writeNumber(rapidjson::Writer<rapidjson::StringBuffer>& writer, double number)
+{
+    writer.Double(number);
+}
+
+NJSON_LOCAL void writeNumber(rapidjson::Writer<rapidjson::StringBuffer>& writer, long long number)
+{
+    writer.Int64(number);
+}
+
+template <typename T>
+std::string writeNumbers(const std::vector<T>& numbers, int max_decimal_places)
+{
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+    if (max_decimal_places >= 0)
+        writer.SetMaxDecimalPlaces(max_decimal_places);
+
+    writer.StartArray();
+    for (auto number : numbers)
+        writeNumber(writer, number);
+    writer.EndArray();
+
+    return std::string(buffer.GetString(), buffer.GetSize());
+}
+
+// number kept as text by NumberMode::rawNumber, false for string values and
+// texts which convert does not take whole
+template <typename T>
+bool convertRawNumber(const NativeValue& native_value, const RawNumbers* raw_numbers, T (*convert)(const char*, char**), T& number)
+{
+    if (!raw_numbers || !raw_numbers->contains(native_value))
+        return false;
+
+    const char* text = native_value.GetString();
+    char* end = nullptr;
+
+    number = convert(text, &end);
+
+    return end == text + native_value.GetStringLength();
+}
+
+// number kept as text by NumberMode::rawNumber, string values are not
+// converted
+template <typename T>
+T fromRawNumber(const NativeValue* native_value, const RawNumbers* raw_numbers, T (*convert)(const char*, char**))
+{
+    T number;
+
+    return convertRawNumber(*native_value, raw_numbers, convert, number) ? number : 0;
+}
+
+NJSON_LOCAL long long toLargestInt(const char* text, char** end)
+{
+    return strtoll(text, end, 10);
+}
+
+NJSON_LOCAL unsigned long long toLargestUInt(const char* text, char** end)
+{
+    if (*text == '-') {
+        *end = const_cast<char*>(text);
+        return 0;
+    }
+
+    return strtoull(text, end, 10);
+}
+
+NJSON_LOCAL bool getNumberOf(const NativeValue& item, const RawNumbers* raw_numbers, double& number)
+{
+    if (item.IsNumber()) {
+        number = item.GetDouble();
+        return true;
+    }
+
+    return convertRawNumber(item, raw_numbers, strtod, number);
+}
+
+NJSON_LOCAL bool getNumberOf(const NativeValue& item, const RawNumbers* raw_numbers, long long& number)
+{
+    if (item.IsInt64()) {
+        number = item.GetInt64();
+        return true;
+    }
+
+    return convertRawNumber(item, raw_numbers, toLargestInt, number);
+}
+
+// one pass over an array without a Value for each element
+template <typename T>
+bool getNumbersOf(const NativeValue& array, const RawNumbers* raw_numbers, std::vector<T>& numbers)
+{
+    numbers.clear();
+    if (!array.IsArray())
+        return false;
+
+    numbers.reserve(array.Size());
+    for (auto item = array.Begin(); item != array.End(); ++item) {
+        T number;
+
+        if (!getNumberOf(*item, raw_numbers, number)) {
+            numbers.clear();
+            return false;
+        }
+
+        numbers.push_back(number);
+    }
+
+    return true;
+}
+
+// shortest decimal which converts back to the same float, see
+// toShortestDouble(). The float is formatted once with 9 digits, which always
+// convert back, shorter ones are rounded from them. A float is less than 1e-7
+// of its value off any decimal converting back to it while 6 digits are 1e-6
+// apart, so the 6 digits are those of a shorter one followed by zeros if there
+// is one
+NJSON_LOCAL double formatShortestDouble(float value)
+{
+    char formatted[32];
+
+    if (!std::isfinite(value) || value == 0)
+        return value;
+
+    // [-]d.dddddddde[+-]xx
+    snprintf(formatted, sizeof(formatted), "%.8e", value);
+
+    bool negative = formatted[0] == '-';
+    const char* mantissa = formatted + (negative ? 1 : 0);
+    int power = atoi(strchr(mantissa, 'e') + 1);
+    char digits[9];
+
+    digits[0] = mantissa[0];
+    memcpy(digits + 1, mantissa + 2, 8);
+
+    for (int precision = 6; precision < 9; precision++) {
+        char rounded[9];
+        int rounded_power = power;
+
+        memcpy(rounded, digits, precision);
+        if (digits[precision] >= '5') {
+            int i = precision - 1;
+
+            for (; i >= 0 && rounded[i] == '9'; i--)
+                rounded[i] = '0';
+
+            // 9.99 is rounded up to 10.0
+            if (i >= 0) {
+                rounded[i]++;
+            } else {
+                rounded[0] = '1';
+                rounded_power++;
+            }
+        }
+
+        // the digits as an integer with the exponent adjusted for them
+        char candidate[32];
+        char* output = candidate;
+        int exponent = rounded_power - precision + 1;
+        char exponent_digits[4];
+        int count = 0;
+
+        if (negative)
+            *output++ = '-';
+        memcpy(output, rounded, precision);
+        output += precision;
+        *output++ = 'e';
+        if (exponent < 0) {
+            *output++ = '-';
+            exponent = -exponent;
+        }
+        do {
+            exponent_digits[count++] = static_cast<char>('0' + exponent % 10);
+            exponent /= 10;
+        } while (exponent);
+        while (count)
+            *output++ = exponent_digits[--count];
+        *output = '\0';
+
+        // asFloat() converts the double back
+        double number = strtod(candidate, nullptr);
+        if (static_cast<float>(number) == value)
+            return number;
+    }
+
+    return strtod(formatted, nullptr);
+}
+
+// shortest decimal which converts back to the same float, so that 3.14f is
+// written as 3.14 instead of 3.140000104904175. The decimal of p digits is
+// m * 10^-k for an integer m, which is exactly what strtod() returns for it as
+// long as m and 10^k are exact doubles, since a division or a product of exact
+// doubles is rounded correctly. Floats needing 10^k beyond 1e22 are formatted
+NJSON_LOCAL double toShortestDouble(float value)
+{
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    if (!std::isfinite(value) || value == 0)
+        return value;
+
+    double magnitude = std::fabs(static_cast<double>(value));
+    int power = static_cast<int>(std::floor(std::log10(magnitude)));
+
+    for (int precision = 6; precision < 10; precision++) {
+        int shift = precision - 1 - power;
+
+        if (shift > 22 || shift < -22)
+            break;
+
+        double number = shift >= 0 ? std::nearbyint(magnitude * powers[shift]) / powers[shift]
+                                   : std::nearbyint(magnitude / powers[-shift]) * powers[-shift];
+
+        if (value < 0)
+            number = -number;
+
+        // asFloat() converts the double back
+        if (static_cast<float>(number) == value)
+            return number;
+    }
+
+    return formatShortestDouble(value);
+}
+
+/*******************************************************************************
+ * define helper structure
+ ******************************************************************************/
+// writes a complete value as FastWriter does, so that the output of several
+// writers put together is the same
+NJSON_LOCAL void writeValue(rapidjson::StringBuffer& buffer, const NativeValue& node, int max_decimal_places, const RawNumbers* raw_numbers = nullptr)
+{
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+    if (max_decimal_places >= 0)
+        writer.SetMaxDecimalPlaces(max_decimal_places);
+    acceptValue(node, writer, raw_numbers);
+}
+
+struct StringViewHash {
+    size_t operator()(StringView str) const;
+};
+
+// size of the chunks read from and written to compressed streams
+static const size_t stream_chunk_size = 64 * 1024;
+
+// RapidJSON input stream of plain, gzip or zstd json, decompressing a chunk
+// at a time. The compression is detected from the first bytes.
+class DecompressStream {
+public:
+    typedef char Ch;
+
+    explicit DecompressStream(std::istream& input_stream)
+        : input_stream(input_stream)
+        , input(stream_chunk_size)
+        , input_next(nullptr)
+        , input_end(nullptr)
+        , input_ended(!input_stream.good())
+        , current(nullptr)
+        , end(nullptr)
+        , count(0)
+        , compression(noCompression)
+        , pending(false)
+        , ended(true)
+        , valid(true)
+    {
+        readInput();
+
+        const unsigned char* magic = reinterpret_cast<const unsigned char*>(input_next);
+        size_t size = input_end - input_next;
+
+        if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+            compression = gzipCompression;
+        else if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+            compression = zstdCompression;
+
+        switch (compression) {
+        case gzipCompression:
+#ifdef NJSON_WITH_ZLIB
+            std::memset(&zstream, 0, sizeof(zstream));
+            // 32 lets zlib take the gzip header
+            valid = inflateInit2(&zstream, 15 + 32) == Z_OK;
+#else
+            valid = false;
+#endif
+            break;
+        case zstdCompression:
+#ifdef NJSON_WITH_ZSTD
+            dstream = ZSTD_createDStream();
+            valid = dstream && !ZSTD_isError(ZSTD_initDStream(dstream));
+#else
+            valid = false;
+#endif
+            break;
+        default:
+            break;
+        }
+
+        if (compression != noCompression) {
+            output.resize(stream_chunk_size);
+            ended = false;
+        }
+
+        if (valid)
+            fill();
+    }
+
+    ~DecompressStream()
+    {
+#ifdef NJSON_WITH_ZLIB
+        if (compression == gzipCompression)
+            inflateEnd(&zstream);
+#endif
+#ifdef NJSON_WITH_ZSTD
+        if (compression == zstdCompression)
+            ZSTD_freeDStream(dstream);
+#endif
+    }
+
+    // false if the compression is not supported or the data is corrupt
+    bool isValid() const
+    {
+        return valid;
+    }
+
+    Ch Peek() const
+    {
+        return current != end ? *current : '\0';
+    }
+
+    Ch Take()
+    {
+        if (current == end)
+            return '\0';
+
+        Ch c = *current++;
+
+        count++;
+        if (current == end)
+            fill();
+
+        return c;
+    }
+
+    size_t Tell() const
+    {
+        return count;
+    }
+
+    // not writable, needed only to compile
+    Ch* PutBegin()
+    {
+        return nullptr;
+    }
+
+    void Put(Ch)
+    {
+    }
+
+    void Flush()
+    {
+    }
+
+    size_t PutEnd(Ch*)
+    {
+        return 0;
+    }
+
+private:
+    // the buffer of the stream is read directly so that the state of the
+    // stream is left to its owner, a short read is the end of the input
+    bool readInput()
+    {
+        std::streambuf* buffer = input_stream.rdbuf();
+        std::streamsize read = (input_ended || !buffer) ? 0 : buffer->sgetn(input.data(), input.size());
+
+        input_ended = read < static_cast<std::streamsize>(input.size());
+        input_next = input.data();
+        input_end = input_next + read;
+
+        return input_next != input_end;
+    }
+
+    void fill()
+    {
+        current = end = nullptr;
+
+        if (compression == noCompression) {
+            if (input_next != input_end || readInput()) {
+                current = input_next;
+                end = input_end;
+                input_next = input_end;
+            }
+            return;
+        }
+
+        while (valid) {
+            if (input_next == input_end && !pending && !readInput()) {
+                // truncated in the middle of a compressed stream
+                valid = ended;
+                return;
+            }
+
+            const char* previous = input_next;
+            size_t produced = decompress();
+
+            if (produced) {
+                current = output.data();
+                end = current + produced;
+                return;
+            }
+
+            if (!pending && input_next == previous && input_next != input_end)
+                valid = false;
+        }
+    }
+
+    // decompresses from input to output, returns the number of bytes produced
+    size_t decompress()
+    {
+        size_t produced = 0;
+
+        switch (compression) {
+#ifdef NJSON_WITH_ZLIB
+        case gzipCompression: {
+            zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input_next));
+            zstream.avail_in = static_cast<uInt>(input_end - input_next);
+            zstream.next_out = reinterpret_cast<Bytef*>(output.data());
+            zstream.avail_out = static_cast<uInt>(output.size());
+
+            int result = inflate(&zstream, Z_NO_FLUSH);
+
+            input_next = input_end - zstream.avail_in;
+            produced = output.size() - zstream.avail_out;
+            pending = zstream.avail_out == 0;
+            if (result == Z_STREAM_END) {
+                // more gzip members may follow
+                ended = true;
+                valid = inflateReset(&zstream) == Z_OK;
+            } else if (result == Z_OK) {
+                ended = false;
+            } else if (result != Z_BUF_ERROR) {
+                valid = false;
+            }
+            break;
+        }
+#endif
+#ifdef NJSON_WITH_ZSTD
+        case zstdCompression: {
+            ZSTD_inBuffer in { input_next, static_cast<size_t>(input_end - input_next), 0 };
+            ZSTD_outBuffer out { output.data(), output.size(), 0 };
+            size_t result = ZSTD_decompressStream(dstream, &out, &in);
+
+            input_next += in.pos;
+            produced = out.pos;
+            pending = out.pos == out.size;
+            if (ZSTD_isError(result))
+                valid = false;
+            else
+                ended = result == 0;
+            break;
+        }
+#endif
+        default:
+            valid = false;
+            break;
+        }
+
+        return produced;
+    }
+
+    std::istream& input_stream;
+    std::vector<char> input;
+    std::vector<char> output;
+    const char* input_next;
+    const char* input_end;
+    // nothing more to read, reported through valid rather than the stream
+    bool input_ended;
+    const char* current;
+    const char* end;
+    size_t count;
+    Compression compression;
+    // the output was full, more may come without reading input
+    bool pending;
+    // at the end of a compressed stream, where the input may stop
+    bool ended;
+    bool valid;
+#ifdef NJSON_WITH_ZLIB
+    z_stream zstream;
+#endif
+#ifdef NJSON_WITH_ZSTD
+    ZSTD_DStream* dstream;
+#endif
+};
+
+// whether the input was read without an error besides the parsing
+NJSON_LOCAL bool isValidStream(const rapidjson::StringStream&)
+{
+    return true;
+}
+
+NJSON_LOCAL bool isValidStream(const DecompressStream& stream)
+{
+    return stream.isValid();
+}
+
+// RapidJSON output stream writing json to output_stream, compressed a chunk at
+// a time. finish() writes the rest.
+class CompressStream {
+public:
+    typedef char Ch;
+
+    CompressStream(std::ostream& output_stream, Compression compression)
+        : output_stream(output_stream)
+        , input(stream_chunk_size)
+        , buffered(0)
+        , compression(compression)
+        , valid(isCompressionSupported(compression))
+    {
+        if (compression != noCompression)
+            output.resize(stream_chunk_size);
+
+#ifdef NJSON_WITH_ZLIB
+        if (compression == gzipCompression) {
+            std::memset(&zstream, 0, sizeof(zstream));
+            // 16 makes zlib write the gzip header
+            valid = deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        }
+#endif
+#ifdef NJSON_WITH_ZSTD
+        if (compression == zstdCompression) {
+            cstream = ZSTD_createCStream();
+            valid = cstream && !ZSTD_isError(ZSTD_initCStream(cstream, ZSTD_CLEVEL_DEFAULT));
+        }
+#endif
+    }
+
+    ~CompressStream()
+    {
+#ifdef NJSON_WITH_ZLIB
+        if (compression == gzipCompression)
+            deflateEnd(&zstream);
+#endif
+#ifdef NJSON_WITH_ZSTD
+        if (compression == zstdCompression)
+            ZSTD_freeCStream(cstream);
+#endif
+    }
+
+    bool isValid() const
+    {
+        return valid;
+    }
+
+    void Put(Ch c)
+    {
+        if (buffered == input.size())
+            compress(false);
+
+        input[buffered++] = c;
+    }
+
+    void write(const char* data, size_t size)
+    {
+        while (size) {
+            if (buffered == input.size())
+                compress(false);
+
+            size_t count = std::min(size, input.size() - buffered);
+
+            std::memcpy(input.data() + buffered, data, count);
+            buffered += count;
+            data += count;
+            size -= count;
+        }
+    }
+
+    // RapidJSON flushes at the end of every root value, the chunks are kept
+    void Flush()
+    {
+    }
+
+    bool finish()
+    {
+        compress(true);
+        output_stream.flush();
+
+        return valid && output_stream.good();
+    }
+
+private:
+    void compress(bool last)
+    {
+        if (!valid)
+            return;
+
+        switch (compression) {
+#ifdef NJSON_WITH_ZLIB
+        case gzipCompression: {
+            int result;
+
+            zstream.next_in = reinterpret_cast<Bytef*>(input.data());
+            zstream.avail_in = static_cast<uInt>(buffered);
+            do {
+                zstream.next_out = reinterpret_cast<Bytef*>(output.data());
+                zstream.avail_out = static_cast<uInt>(output.size());
+                result = deflate(&zstream, last ? Z_FINISH : Z_NO_FLUSH);
+                if (result == Z_STREAM_ERROR) {
+                    valid = false;
+                    break;
+                }
+                output_stream.write(output.data(), output.size() - zstream.avail_out);
+            } while (last ? result != Z_STREAM_END : zstream.avail_out == 0);
+            break;
+        }
+#endif
+#ifdef NJSON_WITH_ZSTD
+        case zstdCompression: {
+            ZSTD_inBuffer in { input.data(), buffered, 0 };
+            size_t remaining;
+
+            do {
+                ZSTD_outBuffer out { output.data(), output.size(), 0 };
+
+                remaining = ZSTD_compressStream2(cstream, &out, &in, last ? ZSTD_e_end : ZSTD_e_continue);
+                if (ZSTD_isError(remaining)) {
+                    valid = false;
+                    break;
+                }
+                output_stream.write(output.data(), out.pos);
+            } while (last ? remaining != 0 : in.pos != in.size);
+            break;
+        }
+#endif
+        default:
+            output_stream.write(input.data(), buffered);
+            break;
+        }
+
+        buffered = 0;
+    }
+
+    std::ostream& output_stream;
+    std::vector<char> input;
+    std::vector<char> output;
+    size_t buffered;
+    Compression compression;
+    bool valid;
+#ifdef NJSON_WITH_ZLIB
+    z_stream zstream;
+#endif
+#ifdef NJSON_WITH_ZSTD
+    ZSTD_CStream* cstream;
+#endif
+};
+
+struct InternTable::InternTableImpl {
+    explicit InternTableImpl(size_t max_value_length)
+        : max_value_length(max_value_length)
+        , referenced_bytes(0)
+        , stats()
+    {
+    }
+
+    size_t max_value_length;
+    size_t referenced_bytes;
+    Stats stats;
+
+    std::mutex mutex;
+    // strings do not move in a deque, the index refers to them
+    std::deque<std::string> storage;
+    std::unordered_set<StringView, StringViewHash> index;
+};
+
+struct ColumnExtractor::ColumnExtractorImpl {
+    enum ColumnType {
+        doubleColumn,
+        integerColumn,
+        stringColumn
+    };
+
+    struct Column {
+        Column(StringView key, ColumnType type)
+            : key(key.data() ? key.data() : "", key.size())
+            , type(type)
+            , hint(0)
+        {
+        }
+
+        std::string key;
+        ColumnType type;
+        // position of the member in the previous element, usually the same
+        rapidjson::SizeType hint;
+        std::vector<double> doubles;
+        std::vector<long long> integers;
+        std::vector<std::string> strings;
+        std::vector<bool> nulls;
+        std::vector<bool> missing;
+    };
+
+    ColumnExtractorImpl()
+        : rows(0)
+        , empty(StringView(), doubleColumn)
+    {
+    }
+
+    const Column* getColumn(size_t column) const
+    {
+        return column < columns.size() ? &columns[column] : &empty;
+    }
+
+    size_t add(StringView key, ColumnType type)
+    {
+        columns.emplace_back(key, type);
+
+        return columns.size() - 1;
+    }
+
+    void clear()
+    {
+        rows = 0;
+        for (auto& column : columns) {
+            column.hint = 0;
+            column.doubles.clear();
+            column.integers.clear();
+            column.strings.clear();
+            column.nulls.clear();
+            column.missing.clear();
+        }
+    }
+
+    std::vector<Column> columns;
+    size_t rows;
+    const Column empty;
+};
+
+// RapidJSON keeps strings up to this length inside the value itself, there is
+// nothing to save by interning them
+static const size_t max_inline_length = 13;
+
+// string for a tree, referring to the one in intern_table if any
+NJSON_LOCAL NativeValue internString(StringView str, InternTable* intern_table, NativeAllocator& allocator)
+{
+    if (intern_table && str.size() > max_inline_length) {
+        StringView interned = intern_table->intern(str);
+
+        return NativeValue(rapidjson::StringRef(interned.data(), interned.size()));
+    }
+
+    return NativeValue(str.data() ? str.data() : "", str.size(), allocator);
+}
+
+// numbers kept as text in raw_numbers are put into node as numbers, for a
+// tree which does not refer to their texts
+NJSON_LOCAL void parseRawNumbers(NativeValue& node, const RawNumbers& raw_numbers)
+{
+    if (node.IsArray()) {
+        for (auto item = node.Begin(); item != node.End(); ++item)
+            parseRawNumbers(*item, raw_numbers);
+    } else if (node.IsObject()) {
+        for (auto member = node.MemberBegin(); member != node.MemberEnd(); ++member)
+            parseRawNumbers(member->value, raw_numbers);
+    } else if (raw_numbers.contains(node)) {
+        rapidjson::Document number;
+
+        // texts are terminated, numbers need no allocator
+        number.Parse(node.GetString());
+        node.Swap(number);
+    }
+}
+
+// ancestors of a tracked value, nearest first
+struct ValuePath {
+    NativeValue* node;
+    std::shared_ptr<ValuePath> parent;
+};
+
+NJSON_LOCAL std::shared_ptr<ValuePath> extendPath(const std::shared_ptr<ValuePath>& parent, NativeValue* node)
+{
+    if (!parent)
+        return nullptr;
+
+    return std::make_shared<ValuePath>(ValuePath { node, parent });
+}
+
+// output of the last FastWriter::write of a tracked value, and where each
+// container was placed in it so that unchanged ones are copied as is, along
+// with the structural hashes of its containers. Writing and hashing hold the
+// mutex so that several threads may write the same tree
+struct SerializationCache {
+    struct Entry {
+        const void* storage;
+        rapidjson::SizeType count;
+        size_t offset; // from the beginning of the parent
+        size_t length;
+        bool valid;
+    };
+
+    struct HashEntry {
+        const void* storage;
+        rapidjson::SizeType count;
+        uint64_t hash;
+    };
+
+    // smaller containers are cheaper to encode again than to remember
+    static const size_t min_length = 64;
+
+    explicit SerializationCache(NativeValue* root)
+        : root(root)
+        , max_decimal_places(-1)
+        , raw_numbers(nullptr)
+    {
+    }
+
+    static const void* storageOf(const NativeValue& node)
+    {
+        if (node.IsArray())
+            return node.Begin();
+
+        return &*node.MemberBegin();
+    }
+
+    static rapidjson::SizeType countOf(const NativeValue& node)
+    {
+        return node.IsArray() ? node.Size() : node.MemberCount();
+    }
+
+    void invalidateNode(const NativeValue* node)
+    {
+        auto entry = entries.find(node);
+        if (entry != entries.end())
+            entry->second.valid = false;
+
+        hashes.erase(node);
+    }
+
+    // every ancestor is marked, one already dirty does not mean the ones above
+    // it are: an emptied container is written without refreshing its entry,
+    // while its ancestors are cached again
+    void invalidate(const ValuePath* path)
+    {
+        for (; path; path = path->parent.get())
+            invalidateNode(path->node);
+    }
+
+    // a cached hash is used only for the container it was computed from, a
+    // node may hold another one after its parent was cleared or erased from
+    const uint64_t* findHash(const NativeValue& node) const
+    {
+        auto found = hashes.find(&node);
+        if (found == hashes.end() || found->second.storage != storageOf(node) || found->second.count != countOf(node))
+            return nullptr;
+
+        return &found->second.hash;
+    }
+
+    void storeHash(const NativeValue& node, uint64_t hash)
+    {
+        hashes[&node] = { storageOf(node), countOf(node), hash };
+    }
+
+    std::string write(int max_decimal_places, const RawNumbers* raw_numbers)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (this->max_decimal_places != max_decimal_places) {
+            this->max_decimal_places = max_decimal_places;
+            entries.clear();
+        }
+
+        this->raw_numbers = raw_numbers;
+
+        rapidjson::StringBuffer buffer;
+
+        buffer.Reserve(output.size());
+        writeNode(buffer, *root, true, 0, 0);
+        output.assign(buffer.GetString(), buffer.GetSize());
+
+        return output;
+    }
+
+    // scalars and empty containers go through writeValue(), the punctuation of
+    // containers is put directly so that cached bytes can be copied in between.
+    // has_previous tells whether the parent is the same container as in the
+    // last output, otherwise the entries of its children are meaningless
+    void writeNode(rapidjson::StringBuffer& buffer, const NativeValue& node, bool has_previous, size_t previous_parent, size_t parent)
+    {
+        if (node.IsArray() ? node.Empty() : !node.IsObject() || node.ObjectEmpty()) {
+            writeValue(buffer, node, max_decimal_places, raw_numbers);
+            return;
+        }
+
+        Entry* entry = nullptr;
+        if (has_previous) {
+            auto found = entries.find(&node);
+            if (found != entries.end() && found->second.storage == storageOf(node) && found->second.count == countOf(node))
+                entry = &found->second;
+        }
+
+        size_t start = buffer.GetSize();
+
+        if (entry && entry->valid) {
+            memcpy(buffer.Push(entry->length), output.data() + previous_parent + entry->offset, entry->length);
+            entry->offset = start - parent;
+            return;
+        }
+
+        size_t previous = entry ? previous_parent + entry->offset : 0;
+
+        if (node.IsArray()) {
+            buffer.Put('[');
+            for (auto item = node.Begin(); item != node.End(); ++item) {
+                if (item != node.Begin())
+                    buffer.Put(',');
+                writeNode(buffer, *item, entry != nullptr, previous, start);
+            }
+            buffer.Put(']');
+        } else {
+            buffer.Put('{');
+            for (auto member = node.MemberBegin(); member != node.MemberEnd(); ++member) {
+                if (member != node.MemberBegin())
+                    buffer.Put(',');
+                writeValue(buffer, member->name, max_decimal_places);
+                buffer.Put(':');
+                writeNode(buffer, member->value, entry != nullptr, previous, start);
+            }
+            buffer.Put('}');
+        }
+
+        size_t length = buffer.GetSize() - start;
+        if (length < min_length) {
+            entries.erase(&node);
+            return;
+        }
+
+        entries[&node] = { storageOf(node), countOf(node), start - parent, length, true };
+    }
+
+    NativeValue* root;
+    int max_decimal_places;
+    const RawNumbers* raw_numbers;
+    std::unordered_map<const NativeValue*, Entry> entries;
+    std::unordered_map<const NativeValue*, HashEntry> hashes;
+    std::string output;
+    std::mutex mutex;
+};
+
+// FNV-1a
+NJSON_LOCAL uint64_t hashBytes(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+NJSON_INLINE size_t StringViewHash::operator()(StringView str) const
+{
+    return static_cast<size_t>(hashBytes(str.data(), str.size()));
+}
+
+// finalizer of MurmurHash3, so that sums of member hashes do not cancel out
+NJSON_LOCAL uint64_t mixHash(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+
+    return value;
+}
+
+// members are summed up so that their order does not matter, numbers are
+// hashed by their double value since 1 and 1.0 are equal
+NJSON_LOCAL uint64_t hashOf(const NativeValue& node, SerializationCache* cache)
+{
+    switch (node.GetType()) {
+    case rapidjson::kNullType:
+        return mixHash(1);
+    case rapidjson::kFalseType:
+        return mixHash(2);
+    case rapidjson::kTrueType:
+        return mixHash(3);
+    case rapidjson::kStringType:
+        return mixHash(hashBytes(node.GetString(), node.GetStringLength()) ^ 4);
+    case rapidjson::kNumberType: {
+        double number = node.GetDouble();
+        uint64_t bits;
+
+        // -0.0 is equal to 0.0
+        if (number == 0)
+            number = 0;
+        memcpy(&bits, &number, sizeof(bits));
+
+        return mixHash(bits ^ 5);
+    }
+    default:
+        break;
+    }
+
+    if (node.IsArray() ? node.Empty() : node.ObjectEmpty())
+        return mixHash(node.IsArray() ? 6 : 7);
+
+    if (cache) {
+        if (const uint64_t* hash = cache->findHash(node))
+            return *hash;
+    }
+
+    uint64_t hash;
+
+    if (node.IsArray()) {
+        hash = 6;
+        for (auto item = node.Begin(); item != node.End(); ++item)
+            hash = mixHash(hash * 31 + hashOf(*item, cache));
+    } else {
+        hash = 7;
+        for (auto member = node.MemberBegin(); member != node.MemberEnd(); ++member)
+            hash += mixHash(hashBytes(member->name.GetString(), member->name.GetStringLength()) * 31 + hashOf(member->value, cache));
+    }
+
+    if (cache)
+        cache->storeHash(node, hash);
+
+    return hash;
+}
+
+// same as the comparison of RapidJSON except that members are looked up by
+// position first
+NJSON_LOCAL bool isEqual(const NativeValue& lhs, const NativeValue& rhs)
+{
+    if (lhs.IsObject() && rhs.IsObject()) {
+        if (lhs.MemberCount() != rhs.MemberCount())
+            return false;
+
+        rapidjson::SizeType index = 0;
+        for (auto member = lhs.MemberBegin(); member != lhs.MemberEnd(); ++member, ++index) {
+            auto other = findMemberAt(rhs, member->name, index);
+
+            if (other == rhs.MemberEnd() || !isEqual(member->value, other->value))
+                return false;
+        }
+
+        return true;
+    }
+
+    if (lhs.IsArray() && rhs.IsArray()) {
+        if (lhs.Size() != rhs.Size())
+            return false;
+
+        for (rapidjson::SizeType i = 0; i < lhs.Size(); i++) {
+            if (!isEqual(lhs[i], rhs[i]))
+                return false;
+        }
+
+        return true;
+    }
+
+    if (lhs.IsNumber() && rhs.IsNumber()) {
+        if (lhs.IsDouble() || rhs.IsDouble())
+            return lhs.GetDouble() == rhs.GetDouble();
+
+        if (lhs.IsInt64() && rhs.IsInt64())
+            return lhs.GetInt64() == rhs.GetInt64();
+
+        return lhs.IsUint64() && rhs.IsUint64() && lhs.GetUint64() == rhs.GetUint64();
+    }
+
+    return lhs == rhs;
+}
+
+// piece of the output of ParallelWriter, either punctuation between the
+// chunks or the elements [begin, end) of container
+struct WriteSegment {
+    const NativeValue* container;
+    rapidjson::SizeType begin;
+    rapidjson::SizeType end;
+    std::string text;
+
+    void encode(int max_decimal_places, const RawNumbers* raw_numbers)
+    {
+        rapidjson::StringBuffer buffer;
+
+        for (rapidjson::SizeType i = begin; i < end; i++) {
+            if (i)
+                buffer.Put(',');
+
+            if (container->IsArray()) {
+                writeValue(buffer, (*container)[i], max_decimal_places, raw_numbers);
+            } else {
+                auto member = container->MemberBegin() + i;
+
+                writeValue(buffer, member->name, max_decimal_places);
+                buffer.Put(':');
+                writeValue(buffer, member->value, max_decimal_places, raw_numbers);
+            }
+        }
+
+        text.assign(buffer.GetString(), buffer.GetSize());
+    }
+};
+
+// chunks are at least this heavy, lighter containers are never split
+static const size_t min_chunk_weight = 1024;
+
+// containers heavier than a chunk are put in weights so that planSegments()
+// does not weigh them again at every level
+NJSON_LOCAL size_t weightOf(const NativeValue& node, std::unordered_map<const NativeValue*, size_t>* weights = nullptr)
+{
+    size_t weight = 1;
+
+    if (node.IsArray()) {
+        for (auto item = node.Begin(); item != node.End(); ++item)
+            weight += weightOf(*item, weights);
+    } else if (node.IsObject()) {
+        for (auto member = node.MemberBegin(); member != node.MemberEnd(); ++member)
+            weight += weightOf(member->value, weights) + 1;
+    }
+
+    if (weights && weight > min_chunk_weight)
+        (*weights)[&node] = weight;
+
+    return weight;
+}
+
+NJSON_LOCAL void addText(std::vector<WriteSegment>& segments, const std::string& text)
+{
+    if (segments.empty() || segments.back().container)
+        segments.push_back({ nullptr, 0, 0, "" });
+
+    segments.back().text += text;
+}
+
+NJSON_LOCAL void addChunk(std::vector<WriteSegment>& segments, const NativeValue& container, rapidjson::SizeType begin, rapidjson::SizeType end)
+{
+    if (begin < end)
+        segments.push_back({ &container, begin, end, "" });
+}
+
+// splits the children of container into chunks of about limit nodes, the
+// children heavier than that are split in turn
+NJSON_LOCAL void planSegments(const NativeValue& container, size_t limit, int max_decimal_places, const RawNumbers* raw_numbers,
+    const std::unordered_map<const NativeValue*, size_t>& weights, std::vector<WriteSegment>& segments)
+{
+    bool is_array = container.IsArray();
+    rapidjson::SizeType count = is_array ? container.Size() : container.MemberCount();
+    rapidjson::SizeType begin = 0;
+    size_t weight = 0;
+
+    addText(segments, is_array ? "[" : "{");
+
+    for (rapidjson::SizeType i = 0; i < count; i++) {
+        const NativeValue& child = is_array ? container[i] : (container.MemberBegin() + i)->value;
+        auto found = weights.find(&child);
+        size_t child_weight = found != weights.end() ? found->second : weightOf(child);
+
+        if (child_weight > limit) {
+            rapidjson::StringBuffer buffer;
+
+            addChunk(segments, container, begin, i);
+
+            if (i)
+                buffer.Put(',');
+            if (!is_array) {
+                writeValue(buffer, (container.MemberBegin() + i)->name, max_decimal_places);
+                buffer.Put(':');
+            }
+            addText(segments, std::string(buffer.GetString(), buffer.GetSize()));
+
+            planSegments(child, limit, max_decimal_places, raw_numbers, weights, segments);
+            begin = i + 1;
+            weight = 0;
+            continue;
+        }
+
+        weight += child_weight;
+        if (weight >= limit) {
+            addChunk(segments, container, begin, i + 1);
+            begin = i + 1;
+            weight = 0;
+        }
+    }
+
+    addChunk(segments, container, begin, count);
+    addText(segments, is_array ? "]" : "}");
+}
+
+// threads kept by a parallel reader or writer across its calls. run() calls
+// work on up to count threads, the calling one included, and returns when all
+// of them are done, rethrowing the first exception thrown by work. Threads are
+// started when first needed and joined by the destructor, also those started
+// before another one failed to start
+class WorkerPool {
+public:
+    explicit WorkerPool(unsigned int size)
+        : size(size)
+        , task(nullptr)
+        , wanted(0)
+        , running(0)
+        , stopping(false)
+    {
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        wake.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    void run(size_t count, const std::function<void()>& work)
+    {
+        // one run at a time when the owner is used by several threads
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+        size_t helpers = std::min<size_t>(count, size);
+        std::exception_ptr failure;
+
+        helpers = helpers ? helpers - 1 : 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            while (threads.size() < helpers)
+                threads.emplace_back(&WorkerPool::loop, this);
+
+            task = &work;
+            wanted = helpers;
+            error = nullptr;
+        }
+        wake.notify_all();
+
+        try {
+            work();
+        } catch (...) {
+            failure = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        finished.wait(lock, [this] { return wanted == 0 && running == 0; });
+        task = nullptr;
+        if (!failure)
+            failure = error;
+        lock.unlock();
+
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+
+private:
+    void loop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            wake.wait(lock, [this] { return stopping || wanted > 0; });
+            if (stopping)
+                return;
+
+            const std::function<void()>* current = task;
+            std::exception_ptr failure;
+
+            wanted--;
+            running++;
+            lock.unlock();
+
+            try {
+                (*current)();
+            } catch (...) {
+                failure = std::current_exception();
+            }
+
+            lock.lock();
+            if (failure && !error)
+                error = failure;
+            if (--running == 0 && wanted == 0)
+                finished.notify_all();
+        }
+    }
+
+    unsigned int size;
+    std::mutex run_mutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::vector<std::thread> threads;
+    const std::function<void()>* task;
+    size_t wanted;
+    size_t running;
+    bool stopping;
+    std::exception_ptr error;
+};
+
+struct Value::Iterator::IteratorArgs {
+    const NativeValueIterator& native_iterator;
+    NativeAllocator* allocator;
+    std::shared_ptr<SerializationCache> cache;
+    std::shared_ptr<ValuePath> path;
+    std::shared_ptr<InternTable> intern_table;
+    std::shared_ptr<RawNumbers> raw_numbers;
+};
+
+struct Value::Iterator::IteratorImpl {
+    NativeValueIterator native_iterator;
+    NativeAllocator* allocator;
+    std::shared_ptr<SerializationCache> cache;
+    std::shared_ptr<ValuePath> path;
+    std::shared_ptr<InternTable> intern_table;
+    std::shared_ptr<RawNumbers> raw_numbers;
+
+    IteratorImpl(const IteratorArgs& args)
+        : native_iterator(args.native_iterator)
+        , allocator(args.allocator)
+        , cache(args.cache)
+        , path(args.path)
+        , intern_table(args.intern_table)
+        , raw_numbers(args.raw_numbers)
+    {
+    }
+};
+
+struct Value::ValueArgs {
+    NativeValue* native_value;
+    NativeAllocator* allocator;
+    std::shared_ptr<SerializationCache> cache;
+    std::shared_ptr<ValuePath> path;
+    std::shared_ptr<InternTable> intern_table;
+    std::shared_ptr<RawNumbers> raw_numbers;
+};
+
+struct Value::ValueImpl {
+    std::shared_ptr<NativeValue> raw_native_value;
+    std::shared_ptr<NativeAllocator> raw_allocator;
+
+    NativeValue* native_value;
+    NativeAllocator* allocator;
+
+    // set while changes are tracked, path starts from native_value itself
+    std::shared_ptr<SerializationCache> cache;
+    std::shared_ptr<ValuePath> path;
+
+    // pools which parts of native_value were parsed into by other threads
+    std::vector<std::shared_ptr<NativeAllocator>> retained_allocators;
+
+    // keys added to the tree are taken from the table it was parsed with
+    std::shared_ptr<InternTable> intern_table;
+    // texts of the numbers kept as text in the tree
+    std::shared_ptr<RawNumbers> raw_numbers;
+
+    ValueImpl()
+        : raw_native_value(std::make_shared<NativeValue>())
+        , raw_allocator(std::make_shared<NativeAllocator>())
+        , native_value(raw_native_value.get())
+        , allocator(raw_allocator.get())
+    {
+    }
+
+    ValueImpl(const ValueArgs& args)
+        : native_value(args.native_value)
+        , allocator(args.allocator)
+        , cache(args.cache)
+        , path(args.path)
+        , intern_table(args.intern_table)
+        , raw_numbers(args.raw_numbers)
+    {
+        if (!this->native_value) {
+            raw_native_value = std::make_shared<NativeValue>();
+            this->native_value = raw_native_value.get();
+        }
+
+        if (!this->allocator) {
+            raw_allocator = std::make_shared<NativeAllocator>();
+            this->allocator = raw_allocator.get();
+        }
+    }
+
+    // the root of a tree of its own, not a view into another tree
+    bool isRoot() const
+    {
+        return raw_native_value && native_value == raw_native_value.get();
+    }
+
+    // a standalone value, not a view into another tree nor a tracked one
+    bool ownsTree() const
+    {
+        return isRoot() && !cache;
+    }
+
+    Value getChild(NativeValue* child) const
+    {
+        return Value({ child, allocator, cache, extendPath(path, child), intern_table, raw_numbers });
+    }
+
+    bool isRawNumber() const
+    {
+        return raw_numbers && raw_numbers->contains(*native_value);
+    }
+
+    // copied came from a tree keeping numbers as text in source, this tree
+    // shares them if it has none of its own, otherwise they are converted
+    void shareRawNumbers(NativeValue& copied, const std::shared_ptr<RawNumbers>& source)
+    {
+        if (!source || source == raw_numbers)
+            return;
+
+        if (raw_allocator && !raw_numbers)
+            raw_numbers = source;
+        else
+            parseRawNumbers(copied, *source);
+    }
+
+    // copied came from a tree referring to the strings of source, this tree
+    // shares the table if it has none of its own, otherwise they are copied
+    void shareInternTable(NativeValue& copied, const std::shared_ptr<InternTable>& source)
+    {
+        if (!source || refersTo(source))
+            return;
+
+        if (raw_allocator && !intern_table)
+            intern_table = source;
+        else
+            copyInterned(copied, *source, *allocator);
+    }
+
+    // readers given the same table hold copies of the same handle
+    bool refersTo(const std::shared_ptr<InternTable>& table) const
+    {
+        return intern_table && table && intern_table->pimpl == table->pimpl;
+    }
+
+    // strings of node stored in intern_table are replaced by copies made
+    // with allocator
+    static void copyInterned(NativeValue& node, const InternTable& intern_table, NativeAllocator& allocator)
+    {
+        auto copy = [&](NativeValue& str) {
+            StringView view(str.GetString(), str.GetStringLength());
+
+            if (view.size() > max_inline_length && intern_table.owns(view))
+                str.SetString(view.data(), static_cast<rapidjson::SizeType>(view.size()), allocator);
+        };
+
+        if (node.IsString()) {
+            copy(node);
+        } else if (node.IsArray()) {
+            for (auto item = node.Begin(); item != node.End(); ++item)
+                copyInterned(*item, intern_table, allocator);
+        } else if (node.IsObject()) {
+            for (auto member = node.MemberBegin(); member != node.MemberEnd(); ++member) {
+                copy(member->name);
+                copyInterned(member->value, intern_table, allocator);
+            }
+        }
+    }
+
+    template <typename T>
+    Value getValue(T key) const
+    {
+        return getChild(&((*native_value)[key]));
+    }
+
+    void touch() const
+    {
+        if (cache)
+            cache->invalidate(path.get());
+    }
+
+    Value getMemberByName(StringView name, bool is_const = false) const
+    {
+        if (native_value->IsNull()) {
+            native_value->SetObject();
+            touch();
+        }
+
+        auto member = native_value->FindMember(toNativeString(name));
+        if (member != native_value->MemberEnd())
+            return getChild(&member->value);
+
+        if (is_const)
+            return Value();
+
+        native_value->AddMember(internString(name, intern_table.get(), *allocator), NativeValue(), *allocator);
+        touch();
+
+        return getChild(&(native_value->MemberEnd() - 1)->value);
+    }
+};
+
+struct Path::PathImpl {
+    struct Token {
+        enum Kind {
+            memberToken,
+            indexToken,
+            wildcardToken
+        };
+
+        Kind kind;
+        std::string name;
+        ArrayIndex index;
+        bool has_index;
+    };
+
+    // path is only kept for the values of a tracked tree
+    struct Match {
+        NativeValue* node;
+        std::shared_ptr<ValuePath> path;
+    };
+
+    std::vector<Token> tokens;
+    bool valid;
+
+    explicit PathImpl(const std::string& expression)
+        : valid(true)
+    {
+        if (expression.empty() || expression[0] == '/')
+            valid = compilePointer(expression);
+        else
+            valid = compileExpression(expression);
+    }
+
+    static bool toIndex(const std::string& text, ArrayIndex& index)
+    {
+        // array index of RFC 6901 has no leading zero
+        if (text.empty() || text.size() > 9 || (text.size() > 1 && text[0] == '0'))
+            return false;
+
+        index = 0;
+        for (auto ch : text) {
+            if (ch < '0' || ch > '9')
+                return false;
+
+            index = index * 10 + (ch - '0');
+        }
+
+        return true;
+    }
+
+    void addMember(const std::string& name)
+    {
+        Token token { Token::memberToken, name, 0, false };
+
+        token.has_index = toIndex(name, token.index);
+        tokens.emplace_back(token);
+    }
+
+    bool compilePointer(const std::string& pointer)
+    {
+        size_t pos = 0;
+
+        while (pos < pointer.size()) {
+            size_t next = pointer.find('/', pos + 1);
+            std::string name;
+
+            if (next == std::string::npos)
+                next = pointer.size();
+
+            for (size_t i = pos + 1; i < next; i++) {
+                if (pointer[i] != '~') {
+                    name += pointer[i];
+                    continue;
+                }
+
+                if (++i >= next)
+                    return false;
+
+                if (pointer[i] == '0')
+                    name += '~';
+                else if (pointer[i] == '1')
+                    name += '/';
+                else
+                    return false;
+            }
+
+            addMember(name);
+            pos = next;
+        }
+
+        return true;
+    }
+
+    bool compileBracket(const std::string& expression, size_t& pos)
+    {
+        size_t close = expression.find(']', pos);
+
+        if (close == std::string::npos)
+            return false;
+
+        char quote = expression[pos];
+        if (quote == '\'' || quote == '"') {
+            std::string name;
+
+            for (pos++; pos < expression.size() && expression[pos] != quote; pos++) {
+                if (expression[pos] == '\\' && pos + 1 < expression.size())
+                    pos++;
+
+                name += expression[pos];
+            }
+
+            if (pos + 1 >= expression.size() || expression[pos + 1] != ']')
+                return false;
+
+            addMember(name);
+            pos += 2;
+
+            return true;
+        }
+
+        std::string text = expression.substr(pos, close - pos);
+        if (text == "*") {
+            tokens.push_back({ Token::wildcardToken, "", 0, false });
+        } else {
+            Token token { Token::indexToken, text, 0, true };
+
+            if (!toIndex(text, token.index))
+                return false;
+
+            tokens.emplace_back(token);
+        }
+
+        pos = close + 1;
+
+        return true;
+    }
+
+    bool compileExpression(const std::string& expression)
+    {
+        size_t pos = 0;
+
+        if (expression[0] == '$')
+            pos++;
+
+        while (pos < expression.size()) {
+            if (expression[pos] == '[') {
+                if (!compileBracket(expression, ++pos))
+                    return false;
+
+                continue;
+            }
+
+            if (expression[pos] == '.')
+                pos++;
+            else if (pos != 0)
+                return false;
+
+            size_t end = expression.find_first_of(".[", pos);
+            if (end == std::string::npos)
+                end = expression.size();
+
+            std::string name = expression.substr(pos, end - pos);
+            if (name.empty())
+                return false;
+
+            if (name == "*")
+                tokens.push_back({ Token::wildcardToken, "", 0, false });
+            else
+                addMember(name);
+
+            pos = end;
+        }
+
+        return true;
+    }
+
+    static NativeValue* step(NativeValue* node, const Token& token)
+    {
+        if (node->IsObject() && token.kind == Token::memberToken) {
+            auto member = node->FindMember(NativeValue(rapidjson::StringRef(token.name.data(), token.name.size())));
+
+            return member != node->MemberEnd() ? &member->value : nullptr;
+        }
+
+        if (node->IsArray() && token.has_index && token.index < node->Size())
+            return &(*node)[token.index];
+
+        return nullptr;
+    }
+
+    void collect(NativeValue* node, std::shared_ptr<ValuePath> path, size_t depth, std::vector<Match>& matches) const
+    {
+        for (; depth < tokens.size(); depth++) {
+            const Token& token = tokens[depth];
+
+            if (token.kind == Token::wildcardToken) {
+                if (node->IsArray()) {
+                    for (auto item = node->Begin(); item != node->End(); ++item)
+                        collect(item, extendPath(path, item), depth + 1, matches);
+                } else if (node->IsObject()) {
+                    for (auto member = node->MemberBegin(); member != node->MemberEnd(); ++member)
+                        collect(&member->value, extendPath(path, &member->value), depth + 1, matches);
+                }
+
+                return;
+            }
+
+            if (!(node = step(node, token)))
+                return;
+
+            path = extendPath(path, node);
+        }
+
+        matches.push_back({ node, path });
+    }
+
+    // container of the location a JSON Pointer refers to, every container on
+    // the way is marked as modified in cache when one is given
+    NativeValue* locateParent(NativeValue* node, SerializationCache* cache = nullptr) const
+    {
+        for (size_t depth = 0; node && depth + 1 < tokens.size(); depth++) {
+            if (cache)
+                cache->invalidateNode(node);
+            node = step(node, tokens[depth]);
+        }
+
+        if (node && cache)
+            cache->invalidateNode(node);
+
+        return node;
+    }
+
+    NativeValue* locate(NativeValue* parent) const
+    {
+        return tokens.empty() ? parent : step(parent, tokens.back());
+    }
+};
+
+struct Builder::BuilderImpl {
+    // bytes kept in the buffer before writing them to the output stream
+    static const size_t flush_size = 64 * 1024;
+
+    explicit BuilderImpl(std::ostream* output_stream = nullptr, Compression compression = noCompression)
+        : writer(buffer)
+        , output_stream(output_stream)
+        , key_written(false)
+        , complete(false)
+        , valid(true)
+    {
+        if (output_stream && compression != noCompression) {
+            compress_stream.reset(new CompressStream(*output_stream, compression));
+            valid = compress_stream->isValid();
+        }
+    }
+
+    // an unfinished document is still written as a complete compressed stream
+    ~BuilderImpl()
+    {
+        flush();
+        if (compress_stream && !complete)
+            compress_stream->finish();
+    }
+
+    // checks that a value is expected here, before it is written
+    bool startValue()
+    {
+        if (valid && (containers.empty() ? !complete : containers.back() == rapidjson::kArrayType || key_written)) {
+            key_written = false;
+            return true;
+        }
+
+        valid = false;
+        return false;
+    }
+
+    // the writer refuses some values, such as NaN, which leaves the output
+    // unfinished
+    bool checked(bool written)
+    {
+        if (!written)
+            valid = false;
+
+        return written;
+    }
+
+    void endValue()
+    {
+        if (containers.empty()) {
+            complete = true;
+            flush();
+        } else if (output_stream && buffer.GetSize() >= flush_size) {
+            flush();
+        }
+    }
+
+    bool startKey()
+    {
+        if (valid && !containers.empty() && containers.back() == rapidjson::kObjectType && !key_written) {
+            key_written = true;
+            return true;
+        }
+
+        valid = false;
+        return false;
+    }
+
+    bool endContainer(rapidjson::Type type)
+    {
+        if (valid && !containers.empty() && containers.back() == type && !key_written) {
+            containers.pop_back();
+            return true;
+        }
+
+        valid = false;
+        return false;
+    }
+
+    void flush()
+    {
+        if (!output_stream || !buffer.GetSize())
+            return;
+
+        if (compress_stream) {
+            compress_stream->write(buffer.GetString(), buffer.GetSize());
+            if (complete && !compress_stream->finish())
+                valid = false;
+        } else {
+            output_stream->write(buffer.GetString(), buffer.GetSize());
+        }
+        buffer.Clear();
+        if (output_stream->fail())
+            valid = false;
+    }
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer;
+    std::ostream* output_stream;
+    std::unique_ptr<CompressStream> compress_stream;
+    std::vector<rapidjson::Type> containers;
+    bool key_written;
+    bool complete;
+    bool valid;
+};
+
+class SlotHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, SlotHandler> {
+public:
+    explicit SlotHandler(const detail::Slot& root)
+        : root(root)
+    {
+    }
+
+    bool Null()
+    {
+        return scalar({ detail::Scalar::nullKind, false, 0, 0, 0, nullptr, 0 });
+    }
+
+    bool Bool(bool value)
+    {
+        return scalar({ detail::Scalar::boolKind, value, 0, 0, 0, nullptr, 0 });
+    }
+
+    bool Int(int value)
+    {
+        return Int64(value);
+    }
+
+    bool Uint(unsigned int value)
+    {
+        return Uint64(value);
+    }
+
+    bool Int64(int64_t value)
+    {
+        return scalar({ detail::Scalar::intKind, false, value, 0, 0, nullptr, 0 });
+    }
+
+    bool Uint64(uint64_t value)
+    {
+        return scalar({ detail::Scalar::uintKind, false, 0, value, 0, nullptr, 0 });
+    }
+
+    bool Double(double value)
+    {
+        return scalar({ detail::Scalar::doubleKind, false, 0, 0, value, nullptr, 0 });
+    }
+
+    bool String(const char* value, rapidjson::SizeType length, bool)
+    {
+        return scalar({ detail::Scalar::stringKind, false, 0, 0, 0, value, length });
+    }
+
+    bool StartObject()
+    {
+        return start(false);
+    }
+
+    bool Key(const char* name, rapidjson::SizeType length, bool)
+    {
+        const Frame& frame = frames.back();
+
+        if (frame.slot.type)
+            frame.slot.type->member(frame.slot.object, name, length, pending);
+        else
+            pending = { nullptr, nullptr };
+
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType)
+    {
+        frames.pop_back();
+
+        return true;
+    }
+
+    bool StartArray()
+    {
+        return start(true);
+    }
+
+    bool EndArray(rapidjson::SizeType)
+    {
+        frames.pop_back();
+
+        return true;
+    }
+
+private:
+    struct Frame {
+        detail::Slot slot;
+        bool is_array;
+    };
+
+    detail::Slot next()
+    {
+        if (frames.empty())
+            return root;
+
+        const Frame& frame = frames.back();
+        if (!frame.slot.type)
+            return { nullptr, nullptr };
+
+        if (frame.is_array) {
+            detail::Slot slot;
+
+            frame.slot.type->element(frame.slot.object, slot);
+
+            return slot;
+        }
+
+        return pending;
+    }
+
+    bool scalar(const detail::Scalar& value)
+    {
+        detail::Slot slot = next();
+
+        // skipped value or null of container
+        if (!slot.type)
+            return true;
+        if (!slot.type->scalar)
+            return value.kind == detail::Scalar::nullKind;
+
+        return slot.type->scalar(slot.object, value);
+    }
+
+    bool start(bool is_array)
+    {
+        detail::Slot slot = next();
+
+        if (slot.type) {
+            if (is_array ? !slot.type->element : !slot.type->member)
+                return false;
+
+            if (slot.type->start)
+                slot.type->start(slot.object);
+        }
+
+        frames.push_back({ slot, is_array });
+
+        return true;
+    }
+
+    detail::Slot root;
+    detail::Slot pending;
+    std::vector<Frame> frames;
+};
+
+class NativeBuilder : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, NativeBuilder> {
+public:
+    NativeBuilder(NativeValue& root, NativeAllocator& allocator, InternTable* intern_table = nullptr, RawNumbers* raw_numbers = nullptr)
+        : root(root)
+        , allocator(allocator)
+        , intern_table(intern_table)
+        , raw_numbers(raw_numbers)
+    {
+    }
+
+    bool Null()
+    {
+        return add(NativeValue());
+    }
+
+    bool Bool(bool value)
+    {
+        return add(NativeValue(value));
+    }
+
+    bool Int(int value)
+    {
+        return add(NativeValue(value));
+    }
+
+    bool Uint(unsigned int value)
+    {
+        return add(NativeValue(value));
+    }
+
+    bool Int64(int64_t value)
+    {
+        return add(NativeValue(value));
+    }
+
+    bool Uint64(uint64_t value)
+    {
+        return add(NativeValue(value));
+    }
+
+    bool Double(double value)
+    {
+        return add(NativeValue(value));
+    }
+
+    bool String(const char* value, rapidjson::SizeType length, bool)
+    {
+        if (intern_table && length <= intern_table->getMaxValueLength())
+            return add(internString(StringView(value, length), intern_table, allocator));
+
+        return add(NativeValue(value, length, allocator));
+    }
+
+    bool RawNumber(const char* value, rapidjson::SizeType length, bool copy)
+    {
+        if (!raw_numbers)
+            return String(value, length, copy);
+
+        StringView text = raw_numbers->add(value, length);
+
+        return add(NativeValue(rapidjson::StringRef(text.data(), text.size())));
+    }
+
+    bool StartObject()
+    {
+        containers.push_back(add(NativeValue(rapidjson::kObjectType)));
+
+        return true;
+    }
+
+    bool Key(const char* name, rapidjson::SizeType length, bool)
+    {
+        key = internString(StringView(name, length), intern_table, allocator);
+
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType)
+    {
+        containers.pop_back();
+
+        return true;
+    }
+
+    bool StartArray()
+    {
+        containers.push_back(add(NativeValue(rapidjson::kArrayType)));
+
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType)
+    {
+        containers.pop_back();
+
+        return true;
+    }
+
+    bool isComplete() const
+    {
+        return containers.empty();
+    }
+
+private:
+    NativeValue* add(NativeValue&& value)
+    {
+        if (containers.empty()) {
+            root = value;
+
+            return &root;
+        }
+
+        NativeValue* parent = containers.back();
+        if (parent->IsArray()) {
+            parent->PushBack(value, allocator);
+
+            return &(*parent)[parent->Size() - 1];
+        }
+
+        parent->AddMember(key, value, allocator);
+
+        return &(parent->MemberEnd() - 1)->value;
+    }
+
+    NativeValue& root;
+    NativeAllocator& allocator;
+    InternTable* intern_table;
+    RawNumbers* raw_numbers;
+    NativeValue key;
+    std::vector<NativeValue*> containers;
+};
+
+// collects the elements of an array of numbers without building a tree, any
+// other value fails the parsing, as well as fractions for integers
+template <typename T>
+class NumberCollector : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, NumberCollector<T>> {
+public:
+    explicit NumberCollector(std::vector<T>& numbers)
+        : numbers(numbers)
+        , depth(0)
+    {
+    }
+
+    bool Default()
+    {
+        return false;
+    }
+
+    bool Int(int value)
+    {
+        return addInteger(value);
+    }
+
+    bool Uint(unsigned int value)
+    {
+        return addInteger(value);
+    }
+
+    bool Int64(int64_t value)
+    {
+        return addInteger(value);
+    }
+
+    bool Uint64(uint64_t value)
+    {
+        if (value <= static_cast<uint64_t>(std::numeric_limits<long long>::max()))
+            return addInteger(static_cast<long long>(value));
+
+        return addFraction(static_cast<double>(value));
+    }
+
+    bool Double(double value)
+    {
+        return addFraction(value);
+    }
+
+    bool RawNumber(const char* text, rapidjson::SizeType length, bool)
+    {
+        std::string number(text, length);
+        char* end = nullptr;
+
+        if (number.find_first_of(".eE") == std::string::npos) {
+            errno = 0;
+            long long integer = strtoll(number.c_str(), &end, 10);
+
+            if (errno != ERANGE)
+                return addInteger(integer);
+        }
+
+        return addFraction(strtod(number.c_str(), &end));
+    }
+
+    bool StartArray()
+    {
+        return depth++ == 0;
+    }
+
+    bool EndArray(rapidjson::SizeType)
+    {
+        depth--;
+
+        return true;
+    }
+
+private:
+    bool addInteger(long long value)
+    {
+        if (depth != 1)
+            return false;
+
+        numbers.push_back(static_cast<T>(value));
+
+        return true;
+    }
+
+    bool addFraction(double value)
+    {
+        if (depth != 1 || std::is_integral<T>::value)
+            return false;
+
+        numbers.push_back(static_cast<T>(value));
+
+        return true;
+    }
+
+    std::vector<T>& numbers;
+    size_t depth;
+};
+
+// splits the elements of the top level array into chunks of about chunk_size
+// bytes. Only strings and nesting are followed, the elements are validated
+// when they are parsed.
+NJSON_LOCAL bool splitArray(const std::string& data, size_t chunk_size, std::vector<std::pair<size_t, size_t>>& chunks)
+{
+    size_t pos = data.find_first_not_of(" \t\r\n");
+
+    if (pos == std::string::npos || data[pos] != '[')
+        return false;
+
+    size_t begin = ++pos;
+    size_t depth = 1;
+    bool in_string = false;
+
+    for (; pos < data.size(); pos++) {
+        char ch = data[pos];
+
+        if (in_string) {
+            if (ch == '\\')
+                pos++;
+            else if (ch == '"')
+                in_string = false;
+
+            continue;
+        }
+
+        if (ch == '"') {
+            in_string = true;
+        } else if (ch == '[' || ch == '{') {
+            depth++;
+        } else if (ch == ']' || ch == '}') {
+            if (--depth == 0)
+                break;
+        } else if (ch == ',' && depth == 1 && pos - begin >= chunk_size) {
+            chunks.emplace_back(begin, pos);
+            begin = pos + 1;
+        }
+    }
+
+    if (pos >= data.size() || data[pos] != ']' || data.find_first_not_of(" \t\r\n", pos + 1) != std::string::npos)
+        return false;
+
+    chunks.emplace_back(begin, pos);
+
+    return true;
+}
+
+// parses the comma separated elements of data[begin, end) into elements
+template <unsigned flags>
+bool parseElements(const std::string& data, std::pair<size_t, size_t> range, NativeValue& elements, NativeAllocator& allocator, InternTable* intern_table, RawNumbers* raw_numbers)
+{
+    rapidjson::Reader reader;
+    rapidjson::MemoryStream input_stream(data.data() + range.first, range.second - range.first);
+    size_t size = range.second - range.first;
+
+    elements.SetArray();
+
+    while (true) {
+        NativeValue element;
+        NativeBuilder builder(element, allocator, intern_table, raw_numbers);
+
+        if (reader.Parse<flags | rapidjson::kParseStopWhenDoneFlag>(input_stream, builder).IsError())
+            return false;
+
+        elements.PushBack(element, allocator);
+
+        while (input_stream.Tell() < size) {
+            char ch = input_stream.Peek();
+
+            if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n')
+                break;
+
+            input_stream.Take();
+        }
+
+        if (input_stream.Tell() >= size)
+            return true;
+
+        if (input_stream.Take() != ',')
+            return false;
+    }
+}
+
+NJSON_LOCAL bool parseElements(const std::string& data, std::pair<size_t, size_t> range, NativeValue& elements, NativeAllocator& allocator, NumberMode number_mode, InternTable* intern_table, RawNumbers& raw_numbers)
+{
+    switch (number_mode) {
+    case NumberMode::fullPrecisionNumber:
+        return parseElements<rapidjson::kParseFullPrecisionFlag>(data, range, elements, allocator, intern_table, nullptr);
+    case NumberMode::rawNumber:
+        return parseElements<rapidjson::kParseNumbersAsStringsFlag>(data, range, elements, allocator, intern_table, &raw_numbers);
+    default:
+        return parseElements<rapidjson::kParseDefaultFlags>(data, range, elements, allocator, intern_table, nullptr);
+    }
+}
+
+class Reader::ProjectionHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, Reader::ProjectionHandler> {
+public:
+    ProjectionHandler(const std::vector<Path::PathImpl*>& paths, NativeValue& root, NativeAllocator& allocator, InternTable* intern_table, RawNumbers* raw_numbers)
+        : paths(paths)
+        , root(root)
+        , allocator(allocator)
+        , intern_table(intern_table)
+        , skip_depth(0)
+        , capture_builder(capture, allocator, intern_table, raw_numbers)
+        , capture_depth(0)
+    {
+    }
+
+    bool Null()
+    {
+        return scalar(&NativeBuilder::Null);
+    }
+
+    bool Bool(bool value)
+    {
+        return scalar(&NativeBuilder::Bool, value);
+    }
+
+    bool Int(int value)
+    {
+        return scalar(&NativeBuilder::Int, value);
+    }
+
+    bool Uint(unsigned int value)
+    {
+        return scalar(&NativeBuilder::Uint, value);
+    }
+
+    bool Int64(int64_t value)
+    {
+        return scalar(&NativeBuilder::Int64, value);
+    }
+
+    bool Uint64(uint64_t value)
+    {
+        return scalar(&NativeBuilder::Uint64, value);
+    }
+
+    bool Double(double value)
+    {
+        return scalar(&NativeBuilder::Double, value);
+    }
+
+    bool String(const char* value, rapidjson::SizeType length, bool copy)
+    {
+        return scalar(&NativeBuilder::String, value, length, copy);
+    }
+
+    bool RawNumber(const char* value, rapidjson::SizeType length, bool copy)
+    {
+        return scalar(&NativeBuilder::RawNumber, value, length, copy);
+    }
+
+    bool StartObject()
+    {
+        return start(false);
+    }
+
+    bool Key(const char* name, rapidjson::SizeType length, bool copy)
+    {
+        if (capture_depth)
+            return capture_builder.Key(name, length, copy);
+
+        if (!skip_depth)
+            frames.back().key.assign(name, length);
+
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType member_count)
+    {
+        return end(&NativeBuilder::EndObject, member_count);
+    }
+
+    bool StartArray()
+    {
+        return start(true);
+    }
+
+    bool EndArray(rapidjson::SizeType element_count)
+    {
+        return end(&NativeBuilder::EndArray, element_count);
+    }
+
+private:
+    using Match = std::pair<size_t, size_t>;
+
+    struct Frame {
+        bool is_array;
+        ArrayIndex index;
+        std::string key;
+        std::vector<Match> matches;
+    };
+
+    enum Action {
+        skipAction,
+        descendAction,
+        captureAction
+    };
+
+    Action classify(std::vector<Match>& matches) const
+    {
+        if (frames.empty()) {
+            for (size_t i = 0; i < paths.size(); i++) {
+                if (paths[i]->tokens.empty())
+                    return captureAction;
+
+                matches.emplace_back(i, 0);
+            }
+
+            return matches.empty() ? skipAction : descendAction;
+        }
+
+        const Frame& frame = frames.back();
+        for (const auto& match : frame.matches) {
+            const auto& tokens = paths[match.first]->tokens;
+            const auto& token = tokens[match.second];
+            bool matched = false;
+
+            if (token.kind == Path::PathImpl::Token::wildcardToken)
+                matched = true;
+            else if (frame.is_array)
+                matched = token.has_index && token.index == frame.index;
+            else
+                matched = token.kind == Path::PathImpl::Token::memberToken && token.name == frame.key;
+
+            if (!matched)
+                continue;
+
+            if (match.second + 1 == tokens.size())
+                return captureAction;
+
+            matches.emplace_back(match.first, match.second + 1);
+        }
+
+        return matches.empty() ? skipAction : descendAction;
+    }
+
+    void next()
+    {
+        if (!frames.empty())
+            frames.back().index++;
+    }
+
+    template <typename... Args>
+    bool scalar(bool (NativeBuilder::*handler)(Args...), Args... args)
+    {
+        if (capture_depth)
+            return (capture_builder.*handler)(args...);
+
+        if (skip_depth)
+            return true;
+
+        std::vector<Match> matches;
+        if (classify(matches) == captureAction) {
+            (capture_builder.*handler)(args...);
+            commit();
+        }
+
+        next();
+
+        return true;
+    }
+
+    bool start(bool is_array)
+    {
+        if (capture_depth) {
+            capture_depth++;
+
+            return is_array ? capture_builder.StartArray() : capture_builder.StartObject();
+        }
+
+        if (skip_depth) {
+            skip_depth++;
+
+            return true;
+        }
+
+        std::vector<Match> matches;
+        switch (classify(matches)) {
+        case skipAction:
+            skip_depth = 1;
+            break;
+        case captureAction:
+            capture_depth = 1;
+            return is_array ? capture_builder.StartArray() : capture_builder.StartObject();
+        case descendAction:
+            if (frames.empty()) {
+                if (is_array)
+                    root.SetArray();
+                else
+                    root.SetObject();
+            }
+
+            frames.push_back({ is_array, 0, "", std::move(matches) });
+            break;
+        }
+
+        return true;
+    }
+
+    bool end(bool (NativeBuilder::*handler)(rapidjson::SizeType), rapidjson::SizeType count)
+    {
+        if (capture_depth) {
+            (capture_builder.*handler)(count);
+
+            if (--capture_depth == 0) {
+                commit();
+                next();
+            }
+
+            return true;
+        }
+
+        if (skip_depth) {
+            if (--skip_depth == 0)
+                next();
+
+            return true;
+        }
+
+        frames.pop_back();
+        next();
+
+        return true;
+    }
+
+    void commit()
+    {
+        NativeValue* node = &root;
+
+        for (const auto& frame : frames) {
+            if (frame.is_array) {
+                if (!node->IsArray())
+                    node->SetArray();
+
+                while (node->Size() <= frame.index)
+                    node->PushBack(NativeValue(), allocator);
+
+                node = &(*node)[frame.index];
+            } else {
+                if (!node->IsObject())
+                    node->SetObject();
+
+                NativeValue name(rapidjson::StringRef(frame.key.data(), frame.key.size()));
+                auto member = node->FindMember(name);
+
+                if (member != node->MemberEnd()) {
+                    node = &member->value;
+                } else {
+                    node->AddMember(internString(frame.key, intern_table, allocator), NativeValue(), allocator);
+                    node = &(node->MemberEnd() - 1)->value;
+                }
+            }
+        }
+
+        *node = capture;
+    }
+
+    const std::vector<Path::PathImpl*>& paths;
+    NativeValue& root;
+    NativeAllocator& allocator;
+    InternTable* intern_table;
+    std::vector<Frame> frames;
+    size_t skip_depth;
+
+    NativeValue capture;
+    NativeBuilder capture_builder;
+    size_t capture_depth;
+};
+
+/*******************************************************************************
+ * define Value::Iterator
+ ******************************************************************************/
+NJSON_INLINE Value::Iterator::Iterator(const IteratorArgs& args)
+    : iterator_pimpl(std::make_shared<IteratorImpl>(args))
+{
+}
+
+NJSON_INLINE bool Value::Iterator::operator==(const Iterator& other) const
+{
+    return iterator_pimpl->native_iterator == other.iterator_pimpl->native_iterator;
+}
+
+NJSON_INLINE bool Value::Iterator::operator!=(const Iterator& other) const
+{
+    return iterator_pimpl->native_iterator != other.iterator_pimpl->native_iterator;
+}
+
+NJSON_INLINE Value::Iterator& Value::Iterator::operator++()
+{
+    ++(iterator_pimpl->native_iterator);
+
+    return *this;
+}
+
+NJSON_INLINE Value::Iterator& Value::Iterator::operator++(int)
+{
+    (iterator_pimpl->native_iterator)++;
+
+    return *this;
+}
+
+NJSON_INLINE Value::Iterator& Value::Iterator::operator--()
+{
+    --(iterator_pimpl->native_iterator);
+
+    return *this;
+}
+
+NJSON_INLINE Value::Iterator& Value::Iterator::operator--(int)
+{
+    (iterator_pimpl->native_iterator)--;
+
+    return *this;
+}
+
+NJSON_INLINE Value Value::Iterator::operator*()
+{
+    NativeValue* item = iterator_pimpl->native_iterator;
+
+    return Value({ item, iterator_pimpl->allocator, iterator_pimpl->cache, extendPath(iterator_pimpl->path, item), iterator_pimpl->intern_table, iterator_pimpl->raw_numbers });
+}
+
+/*******************************************************************************
+ * define Value
+ ******************************************************************************/
+NJSON_INLINE Value::Value()
+    : pimpl(std::make_shared<ValueImpl>())
+{
+}
+
+NJSON_INLINE Value::Value(const ValueArgs& args)
+    : pimpl(std::make_shared<ValueImpl>(args))
+{
+}
+
+NJSON_INLINE Value::Value(const Value& other)
+    : Value()
+{
+    *this = other;
+}
+
+// the tree of a root is taken over, a view is copied as by the copy
+// constructor since its tree may be gone before the new value
+NJSON_INLINE Value::Value(Value&& other)
+    : Value()
+{
+    if (other.pimpl->isRoot())
+        std::swap(pimpl, other.pimpl);
+    else
+        *this = static_cast<const Value&>(other);
+}
+
+NJSON_INLINE Value::Value(ValueType type)
+    : Value()
+{
+    *this = type;
+}
+
+NJSON_INLINE Value::Value(const std::string& str)
+    : Value()
+{
+    *this = StringView(str);
+}
+
+NJSON_INLINE Value::Value(const char* str)
+    : Value()
+{
+    *this = str;
+}
+
+NJSON_INLINE Value::Value(StringView str)
+    : Value()
+{
+    *this = str;
+}
+
+NJSON_INLINE Value::Value(bool value)
+    : Value()
+{
+    *this = value;
+}
+
+NJSON_INLINE Value::Value(const std::vector<int>& values)
+    : Value(values.data(), values.data() + values.size())
+{
+}
+
+NJSON_INLINE Value::Value(const std::vector<unsigned int>& values)
+    : Value(values.data(), values.data() + values.size())
+{
+}
+
+NJSON_INLINE Value::Value(const std::vector<long long>& values)
+    : Value(values.data(), values.data() + values.size())
+{
+}
+
+NJSON_INLINE Value::Value(const std::vector<double>& values)
+    : Value(values.data(), values.data() + values.size())
+{
+}
+
+NJSON_INLINE Value::Value(const std::vector<std::string>& values)
+    : Value(values.data(), values.data() + values.size())
+{
+}
+
+NJSON_INLINE Value::Value(const int* first, const int* last)
+    : Value()
+{
+    fillArray(*pimpl->native_value, first, last, *pimpl->allocator);
+}
+
+NJSON_INLINE Value::Value(const unsigned int* first, const unsigned int* last)
+    : Value()
+{
+    fillArray(*pimpl->native_value, first, last, *pimpl->allocator);
+}
+
+NJSON_INLINE Value::Value(const long long* first, const long long* last)
+    : Value()
+{
+    fillArray(*pimpl->native_value, first, last, *pimpl->allocator);
+}
+
+NJSON_INLINE Value::Value(const double* first, const double* last)
+    : Value()
+{
+    fillArray(*pimpl->native_value, first, last, *pimpl->allocator);
+}
+
+NJSON_INLINE Value::Value(const std::string* first, const std::string* last)
+    : Value()
+{
+    fillArray(*pimpl->native_value, first, last, *pimpl->allocator);
+}
+
+NJSON_INLINE bool Value::operator==(const Value& other) const
+{
+    if (pimpl->native_value == other.pimpl->native_value)
+        return true;
+
+    // hashes are worth computing only when they are kept for the next time
+    if (pimpl->cache && other.pimpl->cache && hash() != other.hash())
+        return false;
+
+    return isEqual(*pimpl->native_value, *other.pimpl->native_value);
+}
+
+NJSON_INLINE bool Value::operator==(const std::string& str) const
+{
+    return *this == StringView(str);
+}
+
+NJSON_INLINE bool Value::operator==(const char* str) const
+{
+    return str && *this == StringView(str);
+}
+
+NJSON_INLINE bool Value::operator==(StringView str) const
+{
+    return pimpl->native_value->IsString() && asStringView() == str;
+}
+
+NJSON_INLINE Value Value::operator[](StringView name)
+{
+    return pimpl->getMemberByName(name);
+}
+
+NJSON_INLINE const Value Value::operator[](StringView name) const
+{
+    return pimpl->getMemberByName(name, true);
+}
+
+NJSON_INLINE Value Value::operator[](ArrayIndex index)
+{
+    if (!isArray())
+        pimpl->native_value->SetArray();
+
+    if (index >= size())
+        resize(index + 1);
+
+    return pimpl->getValue(index);
+}
+
+NJSON_INLINE const Value Value::operator[](ArrayIndex index) const
+{
+    return pimpl->getValue(index);
+}
+
+NJSON_INLINE Value& Value::operator=(const Value& value)
+{
+    pimpl->native_value->CopyFrom(*value.pimpl->native_value, *pimpl->allocator);
+
+    // interned strings are copied as references
+    pimpl->shareInternTable(*pimpl->native_value, value.pimpl->intern_table);
+    pimpl->shareRawNumbers(*pimpl->native_value, value.pimpl->raw_numbers);
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::operator=(Value&& value)
+{
+    // a view writes into its tree, only standalone values are exchanged
+    if (pimpl->ownsTree() && value.pimpl->ownsTree())
+        std::swap(pimpl, value.pimpl);
+    else
+        *this = static_cast<const Value&>(value);
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::operator=(ValueType type)
+{
+    switch (type) {
+    case ValueType::nullValue:
+        pimpl->native_value->SetNull();
+        break;
+    case ValueType::arrayValue:
+        pimpl->native_value->SetArray();
+        break;
+    };
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::operator=(const std::string& value)
+{
+    return *this = StringView(value);
+}
+
+NJSON_INLINE Value& Value::operator=(const char* value)
+{
+    if (value)
+        pimpl->native_value->SetString(value, *pimpl->allocator);
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::operator=(StringView value)
+{
+    pimpl->native_value->SetString(value.data() ? value.data() : "", value.size(), *pimpl->allocator);
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::operator=(int value)
+{
+    pimpl->native_value->SetInt(value);
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::operator=(unsigned int value)
+{
+    pimpl->native_value->SetUint(value);
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::operator=(long long value)
+{
+    pimpl->native_value->SetInt64(value);
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::operator=(bool value)
+{
+    pimpl->native_value->SetBool(value);
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::operator=(float value)
+{
+    pimpl->native_value->SetDouble(toShortestDouble(value));
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::operator=(double value)
+{
+    pimpl->native_value->SetDouble(value);
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE Value& Value::append(const Value& other)
+{
+    if (!pimpl->native_value->IsArray())
+        pimpl->native_value->SetArray();
+
+    pimpl->native_value->PushBack(NativeValue(*other.pimpl->native_value, *pimpl->allocator), *pimpl->allocator);
+
+    NativeValue& appended = (*pimpl->native_value)[pimpl->native_value->Size() - 1];
+
+    pimpl->shareInternTable(appended, other.pimpl->intern_table);
+    pimpl->shareRawNumbers(appended, other.pimpl->raw_numbers);
+
+    pimpl->touch();
+
+    return *this;
+}
+
+NJSON_INLINE ArrayIndex Value::size() const
+{
+    if (pimpl->native_value->IsArray())
+        return pimpl->native_value->Size();
+
+    return 0;
+}
+
+NJSON_INLINE bool Value::empty() const
+{
+    if (pimpl->native_value->IsArray())
+        return pimpl->native_value->Empty();
+    else if (pimpl->native_value->IsObject())
+        return pimpl->native_value->ObjectEmpty();
+
+    return isNull();
+}
+
+NJSON_INLINE bool Value::isNull() const
+{
+    return pimpl->native_value->IsNull();
+}
+
+NJSON_INLINE bool Value::isMember(StringView name) const
+{
+    return pimpl->native_value->IsObject() && pimpl->native_value->HasMember(toNativeString(name));
+}
+
+NJSON_INLINE bool Value::isObject() const
+{
+    return pimpl->native_value->IsObject();
+}
+
+NJSON_INLINE bool Value::isArray() const
+{
+    return pimpl->native_value->IsArray();
+}
+
+NJSON_INLINE bool Value::isString() const
+{
+    return pimpl->native_value->IsString() && !pimpl->isRawNumber();
+}
+
+NJSON_INLINE bool Value::isInt() const
+{
+    return pimpl->native_value->IsInt();
+}
+
+NJSON_INLINE bool Value::isNumeric() const
+{
+    return pimpl->native_value->IsNumber() || pimpl->isRawNumber();
+}
+
+NJSON_INLINE bool Value::isBool() const
+{
+    return pimpl->native_value->IsBool();
+}
+
+NJSON_INLINE const char* Value::asCString() const
+{
+    if (pimpl->native_value->IsString())
+        return pimpl->native_value->GetString();
+
+    return nullptr;
+}
+
+NJSON_INLINE std::string Value::asString() const
+{
+    StringView str = asStringView();
+
+    return std::string(str.data() ? str.data() : "", str.size());
+}
+
+NJSON_INLINE StringView Value::asStringView() const
+{
+    if (pimpl->native_value->IsString())
+        return StringView(pimpl->native_value->GetString(), pimpl->native_value->GetStringLength());
+
+    return StringView();
+}
+
+NJSON_INLINE int Value::asInt() const
+{
+    if (pimpl->native_value->IsInt())
+        return pimpl->native_value->GetInt();
+
+    long long number = fromRawNumber(pimpl->native_value, pimpl->raw_numbers.get(), toLargestInt);
+    if (number < std::numeric_limits<int>::min() || number > std::numeric_limits<int>::max())
+        return 0;
+
+    return static_cast<int>(number);
+}
+
+NJSON_INLINE unsigned int Value::asUInt() const
+{
+    if (pimpl->native_value->IsUint())
+        return pimpl->native_value->GetUint();
+
+    unsigned long long number = fromRawNumber(pimpl->native_value, pimpl->raw_numbers.get(), toLargestUInt);
+    if (number > std::numeric_limits<unsigned int>::max())
+        return 0;
+
+    return static_cast<unsigned int>(number);
+}
+
+NJSON_INLINE long long Value::asLargestInt() const
+{
+    if (pimpl->native_value->IsInt64())
+        return pimpl->native_value->GetInt64();
+
+    return fromRawNumber(pimpl->native_value, pimpl->raw_numbers.get(), toLargestInt);
+}
+
+NJSON_INLINE bool Value::asBool() const
+{
+    if (pimpl->native_value->IsBool())
+        return pimpl->native_value->GetBool();
+
+    return false;
+}
+
+NJSON_INLINE float Value::asFloat() const
+{
+    return static_cast<float>(asDouble());
+}
+
+NJSON_INLINE double Value::asDouble() const
+{
+    // GetDouble() converts integers as well
+    if (pimpl->native_value->IsNumber())
+        return pimpl->native_value->GetDouble();
+
+    return fromRawNumber(pimpl->native_value, pimpl->raw_numbers.get(), strtod);
+}
+
+NJSON_INLINE Value::Iterator Value::begin() const
+{
+    return Iterator({ pimpl->native_value->Begin(), pimpl->allocator, pimpl->cache, pimpl->path, pimpl->intern_table, pimpl->raw_numbers });
+}
+
+NJSON_INLINE Value::Iterator Value::end() const
+{
+    return Iterator({ pimpl->native_value->End(), pimpl->allocator, pimpl->cache, pimpl->path, pimpl->intern_table, pimpl->raw_numbers });
+}
+
+NJSON_INLINE void Value::swap(Value& other)
+{
+    // numbers kept as text cannot move to a tree not referring to them
+    if (pimpl->raw_numbers != other.pimpl->raw_numbers) {
+        if (pimpl->raw_numbers)
+            parseRawNumbers(*pimpl->native_value, *pimpl->raw_numbers);
+        if (other.pimpl->raw_numbers)
+            parseRawNumbers(*other.pimpl->native_value, *other.pimpl->raw_numbers);
+    }
+
+    other.pimpl->native_value->Swap(*pimpl->native_value);
+    other.pimpl->touch();
+    pimpl->touch();
+}
+
+NJSON_INLINE bool Value::getNumbers(std::vector<double>& numbers) const
+{
+    return getNumbersOf(*pimpl->native_value, pimpl->raw_numbers.get(), numbers);
+}
+
+NJSON_INLINE bool Value::getNumbers(std::vector<long long>& numbers) const
+{
+    return getNumbersOf(*pimpl->native_value, pimpl->raw_numbers.get(), numbers);
+}
+
+NJSON_INLINE void Value::reserve(ArrayIndex size)
+{
+    if (pimpl->native_value->IsNull())
+        pimpl->native_value->SetArray();
+
+    if (pimpl->native_value->IsArray())
+        pimpl->native_value->Reserve(size, *pimpl->allocator);
+    else if (pimpl->native_value->IsObject())
+        reserveMembers(*pimpl->native_value, size, *pimpl->allocator, 0);
+}
+
+NJSON_INLINE void Value::resize(ArrayIndex size)
+{
+    NativeValue& array = *pimpl->native_value;
+
+    if (array.IsNull())
+        array.SetArray();
+    else if (!array.IsArray())
+        return;
+
+    if (size > array.Capacity())
+        array.Reserve(std::max(size, array.Capacity() + (array.Capacity() + 1) / 2), *pimpl->allocator);
+
+    while (array.Size() < size)
+        array.PushBack(NativeValue(), *pimpl->allocator);
+
+    if (array.Size() > size)
+        array.Erase(array.Begin() + size, array.End());
+
+    pimpl->touch();
+}
+
+NJSON_INLINE void Value::clear()
+{
+    if (pimpl->native_value->IsArray())
+        pimpl->native_value->Clear();
+    else if (pimpl->native_value->IsObject())
+        pimpl->native_value->RemoveAllMembers();
+
+    pimpl->touch();
+}
+
+NJSON_INLINE size_t Value::hash() const
+{
+    if (!pimpl->cache)
+        return static_cast<size_t>(hashOf(*pimpl->native_value, nullptr));
+
+    std::lock_guard<std::mutex> lock(pimpl->cache->mutex);
+
+    return static_cast<size_t>(hashOf(*pimpl->native_value, pimpl->cache.get()));
+}
+
+NJSON_INLINE void Value::trackChanges(bool enable)
+{
+    if (enable) {
+        pimpl->cache = std::make_shared<SerializationCache>(pimpl->native_value);
+        pimpl->path = std::make_shared<ValuePath>(ValuePath { pimpl->native_value, nullptr });
+    } else {
+        pimpl->cache.reset();
+        pimpl->path.reset();
+    }
+}
+
+/*******************************************************************************
+ * define Path
+ ******************************************************************************/
+NJSON_INLINE Path::Path(const std::string& expression)
+    : pimpl(std::make_shared<PathImpl>(expression))
+{
+}
+
+NJSON_INLINE Path::Path(const char* expression)
+    : Path(std::string(expression ? expression : ""))
+{
+}
+
+NJSON_INLINE bool Path::isValid() const
+{
+    return pimpl->valid;
+}
+
+NJSON_INLINE Value Path::resolve(const Value& root) const
+{
+    if (!pimpl->valid)
+        return Value();
+
+    NativeValue* node = root.pimpl->native_value;
+    std::shared_ptr<ValuePath> path = root.pimpl->path;
+
+    for (const auto& token : pimpl->tokens) {
+        if (token.kind == PathImpl::Token::wildcardToken) {
+            std::vector<PathImpl::Match> matches;
+
+            pimpl->collect(root.pimpl->native_value, root.pimpl->path, 0, matches);
+            if (matches.empty())
+                return Value();
+
+            return Value::ValueArgs { matches.front().node, root.pimpl->allocator, root.pimpl->cache, matches.front().path, root.pimpl->intern_table, root.pimpl->raw_numbers };
+        }
+
+        if (!(node = PathImpl::step(node, token)))
+            return Value();
+
+        path = extendPath(path, node);
+    }
+
+    return Value::ValueArgs { node, root.pimpl->allocator, root.pimpl->cache, path, root.pimpl->intern_table, root.pimpl->raw_numbers };
+}
+
+NJSON_INLINE std::vector<Value> Path::select(const Value& root) const
+{
+    std::vector<PathImpl::Match> matches;
+    std::vector<Value> values;
+
+    if (pimpl->valid)
+        pimpl->collect(root.pimpl->native_value, root.pimpl->path, 0, matches);
+
+    values.reserve(matches.size());
+    for (const auto& match : matches)
+        values.push_back(Value(Value::ValueArgs { match.node, root.pimpl->allocator, root.pimpl->cache, match.path, root.pimpl->intern_table, root.pimpl->raw_numbers }));
+
+    return values;
+}
+
+/*******************************************************************************
+ * define patch
+ ******************************************************************************/
+NJSON_LOCAL void diffMerge(const NativeValue& from, const NativeValue& to, NativeValue& patch, NativeAllocator& allocator)
+{
+    if (!from.IsObject() || !to.IsObject()) {
+        patch.CopyFrom(to, allocator);
+        return;
+    }
+
+    patch.SetObject();
+
+    rapidjson::SizeType index = 0;
+    for (auto member = from.MemberBegin(); member != from.MemberEnd(); ++member, ++index) {
+        if (findMemberAt(to, member->name, index) == to.MemberEnd())
+            patch.AddMember(NativeValue(member->name, allocator), NativeValue(), allocator);
+    }
+
+    index = 0;
+    for (auto member = to.MemberBegin(); member != to.MemberEnd(); ++member, ++index) {
+        auto previous = findMemberAt(from, member->name, index);
+        NativeValue change;
+
+        if (previous == from.MemberEnd()) {
+            change.CopyFrom(member->value, allocator);
+        } else if (previous->value.IsObject() && member->value.IsObject()) {
+            diffMerge(previous->value, member->value, change, allocator);
+            if (change.ObjectEmpty())
+                continue;
+        } else if (previous->value == member->value) {
+            continue;
+        } else {
+            change.CopyFrom(member->value, allocator);
+        }
+
+        patch.AddMember(NativeValue(member->name, allocator), change, allocator);
+    }
+}
+
+NJSON_LOCAL void mergePatch(NativeValue& target, const NativeValue& patch, NativeAllocator& allocator, SerializationCache* cache)
+{
+    if (!patch.IsObject()) {
+        target.CopyFrom(patch, allocator);
+        return;
+    }
+
+    if (!target.IsObject())
+        target.SetObject();
+    else if (cache)
+        cache->invalidateNode(&target);
+
+    for (auto change = patch.MemberBegin(); change != patch.MemberEnd(); ++change) {
+        auto member = target.FindMember(change->name);
+
+        if (change->value.IsNull()) {
+            if (member != target.MemberEnd())
+                target.EraseMember(member);
+
+            continue;
+        }
+
+        if (member != target.MemberEnd()) {
+            mergePatch(member->value, change->value, allocator, cache);
+            continue;
+        }
+
+        target.AddMember(NativeValue(change->name, allocator), NativeValue(), allocator);
+        mergePatch((target.MemberEnd() - 1)->value, change->value, allocator, cache);
+    }
+}
+
+// escapes a member name as a reference token of RFC 6901
+NJSON_LOCAL std::string toPointerToken(const NativeValue& name)
+{
+    std::string token;
+
+    for (rapidjson::SizeType i = 0; i < name.GetStringLength(); i++) {
+        char ch = name.GetString()[i];
+
+        if (ch == '~')
+            token += "~0";
+        else if (ch == '/')
+            token += "~1";
+        else
+            token += ch;
+    }
+
+    return token;
+}
+
+NJSON_LOCAL void addOperation(NativeValue& operations, const char* op, const std::string& path, const NativeValue* value, NativeAllocator& allocator)
+{
+    NativeValue operation(rapidjson::kObjectType);
+
+    operation.AddMember(NativeValue(rapidjson::StringRef("op")), NativeValue(rapidjson::StringRef(op)), allocator);
+    operation.AddMember(NativeValue(rapidjson::StringRef("path")), NativeValue(path.data(), path.size(), allocator), allocator);
+    if (value)
+        operation.AddMember(NativeValue(rapidjson::StringRef("value")), NativeValue(*value, allocator), allocator);
+
+    operations.PushBack(operation, allocator);
+}
+
+NJSON_LOCAL void diffOperations(const NativeValue& from, const NativeValue& to, const std::string& path, NativeValue& operations, NativeAllocator& allocator)
+{
+    if (from.IsObject() && to.IsObject()) {
+        rapidjson::SizeType index = 0;
+        for (auto member = from.MemberBegin(); member != from.MemberEnd(); ++member, ++index) {
+            if (findMemberAt(to, member->name, index) == to.MemberEnd())
+                addOperation(operations, "remove", path + "/" + toPointerToken(member->name), nullptr, allocator);
+        }
+
+        index = 0;
+        for (auto member = to.MemberBegin(); member != to.MemberEnd(); ++member, ++index) {
+            auto previous = findMemberAt(from, member->name, index);
+            std::string child = path + "/" + toPointerToken(member->name);
+
+            if (previous == from.MemberEnd())
+                addOperation(operations, "add", child, &member->value, allocator);
+            else
+                diffOperations(previous->value, member->value, child, operations, allocator);
+        }
+
+        return;
+    }
+
+    if (from.IsArray() && to.IsArray()) {
+        rapidjson::SizeType common = std::min(from.Size(), to.Size());
+
+        for (rapidjson::SizeType i = 0; i < common; i++)
+            diffOperations(from[i], to[i], path + "/" + std::to_string(i), operations, allocator);
+
+        // from the end so that the remaining indexes stay the same
+        for (rapidjson::SizeType i = from.Size(); i > common; i--)
+            addOperation(operations, "remove", path + "/" + std::to_string(i - 1), nullptr, allocator);
+
+        for (rapidjson::SizeType i = common; i < to.Size(); i++)
+            addOperation(operations, "add", path + "/" + std::to_string(i), &to[i], allocator);
+
+        return;
+    }
+
+    if (!(from == to))
+        addOperation(operations, "replace", path, &to, allocator);
+}
+
+NJSON_LOCAL const NativeValue* getMember(const NativeValue& object, const char* name)
+{
+    auto member = object.FindMember(name);
+
+    return member != object.MemberEnd() ? &member->value : nullptr;
+}
+
+NJSON_LOCAL bool getPointer(const NativeValue& operation, const char* name, std::string& pointer)
+{
+    const NativeValue* value = getMember(operation, name);
+
+    if (!value || !value->IsString())
+        return false;
+
+    pointer.assign(value->GetString(), value->GetStringLength());
+
+    return pointer.empty() || pointer[0] == '/';
+}
+
+NJSON_INLINE Value diff(const Value& from, const Value& to)
+{
+    Value patch;
+
+    diffMerge(*from.pimpl->native_value, *to.pimpl->native_value, *patch.pimpl->native_value, *patch.pimpl->allocator);
+    patch.pimpl->intern_table = to.pimpl->intern_table;
+    patch.pimpl->raw_numbers = to.pimpl->raw_numbers;
+
+    return patch;
+}
+
+NJSON_INLINE void applyPatch(Value& value, const Value& patch)
+{
+    value.pimpl->touch();
+    mergePatch(*value.pimpl->native_value, *patch.pimpl->native_value, *value.pimpl->allocator, value.pimpl->cache.get());
+    value.pimpl->shareInternTable(*value.pimpl->native_value, patch.pimpl->intern_table);
+    value.pimpl->shareRawNumbers(*value.pimpl->native_value, patch.pimpl->raw_numbers);
+}
+
+NJSON_INLINE Value diffJsonPatch(const Value& from, const Value& to)
+{
+    Value operations(ValueType::arrayValue);
+
+    diffOperations(*from.pimpl->native_value, *to.pimpl->native_value, "", *operations.pimpl->native_value, *operations.pimpl->allocator);
+    operations.pimpl->intern_table = to.pimpl->intern_table;
+    operations.pimpl->raw_numbers = to.pimpl->raw_numbers;
+
+    return operations;
+}
+
+// changes made in place by the operations of a JSON Patch, undone in reverse
+// order when a later operation fails. A change is located again from the root
+// when it is undone, since the nodes it touched may have moved since.
+class JsonPatchLog {
+public:
+    JsonPatchLog(NativeValue& root, NativeAllocator& allocator, SerializationCache* cache)
+        : root(root)
+        , allocator(allocator)
+        , cache(cache)
+    {
+    }
+
+    // adds or replaces the location with item, "-" appends to an array
+    bool add(const Path::PathImpl& path, NativeValue& item)
+    {
+        NativeValue* parent = path.locateParent(&root, cache);
+
+        if (!parent)
+            return false;
+
+        if (path.tokens.empty()) {
+            root.Swap(item);
+            record(restoreChange, path).old.Swap(item);
+            return true;
+        }
+
+        const Path::PathImpl::Token& token = path.tokens.back();
+
+        if (parent->IsObject()) {
+            auto member = parent->FindMember(NativeValue(rapidjson::StringRef(token.name.data(), token.name.size())));
+
+            if (member != parent->MemberEnd()) {
+                member->value.Swap(item);
+                record(restoreChange, path).old.Swap(item);
+            } else {
+                parent->AddMember(NativeValue(token.name.data(), token.name.size(), allocator), item, allocator);
+                record(eraseChange, path);
+            }
+
+            return true;
+        }
+
+        if (!parent->IsArray())
+            return false;
+
+        ArrayIndex index = parent->Size();
+
+        if (token.name != "-") {
+            if (!token.has_index || token.index > parent->Size())
+                return false;
+
+            index = token.index;
+        }
+
+        parent->PushBack(item, allocator);
+        for (ArrayIndex i = parent->Size() - 1; i > index; i--)
+            (*parent)[i].Swap((*parent)[i - 1]);
+        record(eraseChange, path).index = index;
+
+        return true;
+    }
+
+    bool remove(const Path::PathImpl& path)
+    {
+        NativeValue* parent = path.locateParent(&root, cache);
+
+        if (!parent)
+            return false;
+
+        if (path.tokens.empty()) {
+            record(restoreChange, path).old.Swap(root);
+            return true;
+        }
+
+        const Path::PathImpl::Token& token = path.tokens.back();
+
+        if (parent->IsObject()) {
+            auto member = parent->FindMember(NativeValue(rapidjson::StringRef(token.name.data(), token.name.size())));
+
+            if (member == parent->MemberEnd())
+                return false;
+
+            Change& change = record(reinsertChange, path);
+
+            change.index = static_cast<ArrayIndex>(member - parent->MemberBegin());
+            change.old.Swap(member->value);
+            change.old_name.Swap(member->name);
+            parent->EraseMember(member);
+        } else if (parent->IsArray() && token.has_index && token.index < parent->Size()) {
+            Change& change = record(reinsertChange, path);
+
+            change.index = token.index;
+            change.old.Swap((*parent)[token.index]);
+            parent->Erase(parent->Begin() + token.index);
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    bool replace(const Path::PathImpl& path, NativeValue& item)
+    {
+        NativeValue* parent = path.locateParent(&root, cache);
+        NativeValue* target = parent ? path.locate(parent) : nullptr;
+
+        if (!target)
+            return false;
+
+        target->Swap(item);
+
+        Change& change = record(restoreChange, path);
+
+        change.old.Swap(item);
+        if (!path.tokens.empty() && parent->IsArray())
+            change.index = path.tokens.back().index;
+
+        return true;
+    }
+
+    void undo()
+    {
+        for (auto change = changes.rbegin(); change != changes.rend(); ++change) {
+            if (change->at_root) {
+                root.Swap(change->old);
+                continue;
+            }
+
+            NativeValue* container = change->container.locate(change->container.locateParent(&root));
+
+            switch (change->kind) {
+            case restoreChange:
+                if (container->IsObject())
+                    container->FindMember(nameOf(*change))->value.Swap(change->old);
+                else
+                    (*container)[change->index].Swap(change->old);
+                break;
+            case eraseChange:
+                if (container->IsObject())
+                    container->EraseMember(container->FindMember(nameOf(*change)));
+                else
+                    container->Erase(container->Begin() + change->index);
+                break;
+            case reinsertChange:
+                if (container->IsObject()) {
+                    container->AddMember(change->old_name, change->old, allocator);
+                    for (auto moved = container->MemberEnd() - 1; moved != container->MemberBegin() + change->index; --moved) {
+                        moved->name.Swap((moved - 1)->name);
+                        moved->value.Swap((moved - 1)->value);
+                    }
+                } else {
+                    container->PushBack(change->old, allocator);
+                    for (ArrayIndex i = container->Size() - 1; i > change->index; i--)
+                        (*container)[i].Swap((*container)[i - 1]);
+                }
+                break;
+            }
+        }
+        changes.clear();
+    }
+
+private:
+    enum ChangeKind {
+        restoreChange,
+        eraseChange,
+        reinsertChange
+    };
+
+    struct Change {
+        Change(ChangeKind kind, const Path::PathImpl& path)
+            : kind(kind)
+            , container(path)
+            , at_root(path.tokens.empty())
+            , name(at_root ? std::string() : path.tokens.back().name)
+            , index(0)
+        {
+            if (!at_root)
+                container.tokens.pop_back();
+        }
+
+        ChangeKind kind;
+        Path::PathImpl container;
+        bool at_root;
+        // member of an object or position of an element
+        std::string name;
+        ArrayIndex index;
+        // value replaced or removed, and the name of a removed member
+        NativeValue old;
+        NativeValue old_name;
+    };
+
+    static NativeValue nameOf(const Change& change)
+    {
+        return NativeValue(rapidjson::StringRef(change.name.data(), change.name.size()));
+    }
+
+    Change& record(ChangeKind kind, const Path::PathImpl& path)
+    {
+        changes.emplace_back(kind, path);
+
+        return changes.back();
+    }
+
+    NativeValue& root;
+    NativeAllocator& allocator;
+    SerializationCache* cache;
+    // a deque does not move the values kept in it
+    std::deque<Change> changes;
+};
+
+// operations are applied in place and undone if one of them fails, so that
+// value is left as it was
+NJSON_INLINE bool applyJsonPatch(Value& value, const Value& patch)
+{
+    const NativeValue& operations = *patch.pimpl->native_value;
+
+    if (!operations.IsArray())
+        return false;
+
+    NativeAllocator& allocator = *value.pimpl->allocator;
+    NativeValue& root = *value.pimpl->native_value;
+    JsonPatchLog log(root, allocator, value.pimpl->cache.get());
+
+    auto apply = [&](const NativeValue& operation) {
+        std::string pointer;
+
+        if (!operation.IsObject() || !getPointer(operation, "path", pointer))
+            return false;
+
+        const NativeValue* op = getMember(operation, "op");
+        const NativeValue* operand = getMember(operation, "value");
+        Path::PathImpl path(pointer);
+        NativeValue item;
+
+        if (!op || !op->IsString() || !path.valid)
+            return false;
+
+        std::string name(op->GetString(), op->GetStringLength());
+
+        if (name == "remove")
+            return log.remove(path);
+
+        if (name == "move" || name == "copy") {
+            std::string from_pointer;
+
+            if (!getPointer(operation, "from", from_pointer))
+                return false;
+
+            // a value cannot be moved into one of its own children
+            if (name == "move" && pointer.compare(0, from_pointer.size() + 1, from_pointer + "/") == 0)
+                return false;
+
+            Path::PathImpl from(from_pointer);
+            NativeValue* from_parent = from.valid ? from.locateParent(&root) : nullptr;
+            const NativeValue* source = from_parent ? from.locate(from_parent) : nullptr;
+
+            if (!source)
+                return false;
+
+            item.CopyFrom(*source, allocator);
+
+            return (name == "copy" || log.remove(from)) && log.add(path, item);
+        }
+
+        if (!operand)
+            return false;
+
+        item.CopyFrom(*operand, allocator);
+        if (name == "add")
+            return log.add(path, item);
+        if (name == "replace")
+            return log.replace(path, item);
+        if (name != "test")
+            return false;
+
+        NativeValue* parent = path.locateParent(&root);
+        NativeValue* target = parent ? path.locate(parent) : nullptr;
+
+        return target && *target == item;
+    };
+
+    for (auto operation = operations.Begin(); operation != operations.End(); ++operation) {
+        if (!apply(*operation)) {
+            log.undo();
+            return false;
+        }
+    }
+
+    value.pimpl->shareInternTable(root, patch.pimpl->intern_table);
+    value.pimpl->shareRawNumbers(root, patch.pimpl->raw_numbers);
+    value.pimpl->touch();
+
+    return true;
+}
+
+/*******************************************************************************
+ * define ColumnExtractor
+ ******************************************************************************/
+NJSON_INLINE ColumnExtractor::ColumnExtractor()
+    : pimpl(std::make_shared<ColumnExtractorImpl>())
+{
+}
+
+NJSON_INLINE size_t ColumnExtractor::addDouble(StringView key)
+{
+    return pimpl->add(key, ColumnExtractorImpl::doubleColumn);
+}
+
+NJSON_INLINE size_t ColumnExtractor::addInteger(StringView key)
+{
+    return pimpl->add(key, ColumnExtractorImpl::integerColumn);
+}
+
+NJSON_INLINE size_t ColumnExtractor::addString(StringView key)
+{
+    return pimpl->add(key, ColumnExtractorImpl::stringColumn);
+}
+
+NJSON_INLINE bool ColumnExtractor::extract(const Value& value)
+{
+    const NativeValue& array = *value.pimpl->native_value;
+    const RawNumbers* raw_numbers = value.pimpl->raw_numbers.get();
+    std::vector<NativeValue> keys;
+
+    pimpl->clear();
+    if (!array.IsArray())
+        return false;
+
+    // columns are sized up front, only the rows without a value are marked
+    for (auto& column : pimpl->columns) {
+        keys.emplace_back(rapidjson::StringRef(column.key.data(), column.key.size()));
+        if (column.type == ColumnExtractorImpl::doubleColumn)
+            column.doubles.resize(array.Size());
+        else if (column.type == ColumnExtractorImpl::integerColumn)
+            column.integers.resize(array.Size());
+        else
+            column.strings.resize(array.Size());
+        column.nulls.resize(array.Size());
+        column.missing.resize(array.Size());
+    }
+
+    size_t row = 0;
+    for (auto item = array.Begin(); item != array.End(); ++item, ++row) {
+        if (!item->IsObject()) {
+            pimpl->clear();
+            return false;
+        }
+
+        for (size_t index = 0; index < pimpl->columns.size(); index++) {
+            auto& column = pimpl->columns[index];
+            auto member = findMemberAt(*item, keys[index], column.hint);
+
+            if (member == item->MemberEnd()) {
+                column.missing[row] = true;
+                continue;
+            }
+
+            column.hint = static_cast<rapidjson::SizeType>(member - item->MemberBegin());
+            if (member->value.IsNull()) {
+                column.nulls[row] = true;
+                continue;
+            }
+
+            // numbers kept as text are converted, and are not strings
+            bool matches = false;
+            switch (column.type) {
+            case ColumnExtractorImpl::doubleColumn:
+                matches = getNumberOf(member->value, raw_numbers, column.doubles[row]);
+                break;
+            case ColumnExtractorImpl::integerColumn:
+                matches = getNumberOf(member->value, raw_numbers, column.integers[row]);
+                break;
+            case ColumnExtractorImpl::stringColumn:
+                if ((matches = member->value.IsString() && !(raw_numbers && raw_numbers->contains(member->value))))
+                    column.strings[row].assign(member->value.GetString(), member->value.GetStringLength());
+                break;
+            }
+
+            if (!matches) {
+                pimpl->clear();
+                return false;
+            }
+        }
+    }
+
+    pimpl->rows = row;
+
+    return true;
+}
+
+NJSON_INLINE size_t ColumnExtractor::getRows() const
+{
+    return pimpl->rows;
+}
+
+NJSON_INLINE const std::vector<double>& ColumnExtractor::getDoubles(size_t column) const
+{
+    return pimpl->getColumn(column)->doubles;
+}
+
+NJSON_INLINE const std::vector<long long>& ColumnExtractor::getIntegers(size_t column) const
+{
+    return pimpl->getColumn(column)->integers;
+}
+
+NJSON_INLINE const std::vector<std::string>& ColumnExtractor::getStrings(size_t column) const
+{
+    return pimpl->getColumn(column)->strings;
+}
+
+NJSON_INLINE const std::vector<bool>& ColumnExtractor::getNulls(size_t column) const
+{
+    return pimpl->getColumn(column)->nulls;
+}
+
+NJSON_INLINE const std::vector<bool>& ColumnExtractor::getMissing(size_t column) const
+{
+    return pimpl->getColumn(column)->missing;
+}
+
+/*******************************************************************************
+ * define InternTable
+ ******************************************************************************/
+NJSON_INLINE InternTable::InternTable(size_t max_value_length)
+    : pimpl(std::make_shared<InternTableImpl>(max_value_length))
+{
+}
+
+NJSON_INLINE StringView InternTable::intern(StringView str)
+{
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+
+    pimpl->stats.references++;
+    pimpl->referenced_bytes += str.size() + 1;
+
+    auto found = pimpl->index.find(str);
+    if (found != pimpl->index.end())
+        return *found;
+
+    pimpl->storage.emplace_back(str.data() ? str.data() : "", str.size());
+    pimpl->stats.strings++;
+    pimpl->stats.stored_bytes += str.size() + 1;
+
+    StringView stored(pimpl->storage.back().data(), str.size());
+    pimpl->index.insert(stored);
+
+    return stored;
+}
+
+NJSON_INLINE size_t InternTable::getMaxValueLength() const
+{
+    return pimpl->max_value_length;
+}
+
+NJSON_INLINE bool InternTable::owns(StringView str) const
+{
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+    auto found = pimpl->index.find(str);
+
+    return found != pimpl->index.end() && found->data() == str.data();
+}
+
+NJSON_INLINE InternTable::Stats InternTable::getStats() const
+{
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+    Stats stats = pimpl->stats;
+
+    if (pimpl->referenced_bytes > stats.stored_bytes)
+        stats.saved_bytes = pimpl->referenced_bytes - stats.stored_bytes;
+
+    return stats;
+}
+
+/*******************************************************************************
+ * define Reader, StyledWriter, FastWriter
+ ******************************************************************************/
+NJSON_INLINE Reader::Reader(NumberMode number_mode)
+    : number_mode(number_mode)
+{
+}
+
+NJSON_INLINE void Reader::setInternTable(const InternTable& intern_table)
+{
+    this->intern_table = std::make_shared<InternTable>(intern_table);
+}
+
+// the tree is built by NativeBuilder when strings are interned or numbers are
+// kept as text, the table and the texts are kept alive by the value owning it
+template <typename InputStream>
+bool Reader::parseStream(InputStream& input_stream, Value& node)
+{
+    bool is_raw = number_mode == NumberMode::rawNumber;
+
+    if ((intern_table && node.pimpl->raw_allocator) || is_raw) {
+        std::shared_ptr<RawNumbers> raw_numbers = is_raw ? std::make_shared<RawNumbers>() : nullptr;
+        NativeValue parsed;
+        NativeBuilder builder(parsed, *node.pimpl->allocator, node.pimpl->raw_allocator ? intern_table.get() : nullptr, raw_numbers.get());
+
+        if (!parseStreamWith(input_stream, builder, number_mode) || !isValidStream(input_stream))
+            return false;
+
+        node.pimpl->native_value->Swap(parsed);
+        if (node.pimpl->raw_allocator) {
+            node.pimpl->intern_table = intern_table;
+            node.pimpl->raw_numbers = raw_numbers;
+        } else if (raw_numbers) {
+            parseRawNumbers(*node.pimpl->native_value, *raw_numbers);
+        }
+        node.pimpl->touch();
+
+        return true;
+    }
+
+    rapidjson::Document document;
+
+    parseDocument(document, input_stream, number_mode);
+
+    if (document.HasParseError() || !isValidStream(input_stream))
+        return false;
+
+    node = Value::ValueArgs { &document, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+    return true;
+}
+
+NJSON_INLINE bool Reader::parse(const std::string& data, Value& node)
+{
+    rapidjson::StringStream input_stream(data.c_str());
+
+    return parseStream(input_stream, node);
+}
+
+NJSON_INLINE bool Reader::parse(std::istream& input_stream, Value& node)
+{
+    DecompressStream stream(input_stream);
+
+    return parseStream(stream, node);
+}
+
+NJSON_INLINE bool Reader::parseFile(const std::string& path, Value& node)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    return parse(file, node);
+}
+
+NJSON_INLINE bool Reader::parse(const std::string& data, Value& node, const std::vector<Path>& projection)
+{
+    std::vector<Path::PathImpl*> paths;
+
+    for (const auto& path : projection) {
+        if (path.pimpl->valid)
+            paths.push_back(path.pimpl.get());
+    }
+
+    std::shared_ptr<RawNumbers> raw_numbers = number_mode == NumberMode::rawNumber ? std::make_shared<RawNumbers>() : nullptr;
+    NativeValue projected;
+    // strings are interned only into a tree which keeps the table alive
+    ProjectionHandler handler(paths, projected, *node.pimpl->allocator, node.pimpl->raw_allocator ? intern_table.get() : nullptr, raw_numbers.get());
+
+    if (!parseWith(data, handler, number_mode))
+        return false;
+
+    *node.pimpl->native_value = projected;
+    if (node.pimpl->raw_allocator) {
+        node.pimpl->intern_table = intern_table;
+        node.pimpl->raw_numbers = raw_numbers;
+    } else if (raw_numbers)
+        parseRawNumbers(*node.pimpl->native_value, *raw_numbers);
+    node.pimpl->touch();
+
+    return true;
+}
+
+NJSON_INLINE bool Reader::parse(const std::string& data, std::vector<double>& numbers)
+{
+    NumberCollector<double> collector(numbers);
+
+    numbers.clear();
+    if (parseWith(data, collector, number_mode))
+        return true;
+
+    numbers.clear();
+
+    return false;
+}
+
+NJSON_INLINE bool Reader::parse(const std::string& data, std::vector<long long>& numbers)
+{
+    NumberCollector<long long> collector(numbers);
+
+    numbers.clear();
+    if (parseWith(data, collector, number_mode))
+        return true;
+
+    numbers.clear();
+
+    return false;
+}
+
+NJSON_INLINE StyledWriter::StyledWriter()
+    : max_decimal_places(-1)
+{
+}
+
+NJSON_INLINE void StyledWriter::setMaxDecimalPlaces(int max_decimal_places)
+{
+    this->max_decimal_places = max_decimal_places;
+}
+
+NJSON_INLINE std::string StyledWriter::write(const Value& value)
+{
+    return stringify<rapidjson::PrettyWriter<rapidjson::StringBuffer>>(value.pimpl->native_value, max_decimal_places, value.pimpl->raw_numbers.get());
+}
+
+NJSON_INLINE bool StyledWriter::write(const Value& value, std::ostream& output_stream, Compression compression)
+{
+    CompressStream stream(output_stream, compression);
+
+    if (!stream.isValid())
+        return false;
+
+    rapidjson::PrettyWriter<CompressStream> writer(stream);
+
+    if (max_decimal_places >= 0)
+        writer.SetMaxDecimalPlaces(max_decimal_places);
+    acceptValue(*value.pimpl->native_value, writer, value.pimpl->raw_numbers.get());
+
+    return stream.finish();
+}
+
+NJSON_INLINE FastWriter::FastWriter()
+    : max_decimal_places(-1)
+{
+}
+
+NJSON_INLINE void FastWriter::setMaxDecimalPlaces(int max_decimal_places)
+{
+    this->max_decimal_places = max_decimal_places;
+}
+
+NJSON_INLINE std::string FastWriter::write(const Value& value)
+{
+    const auto& cache = value.pimpl->cache;
+
+    if (cache && cache->root == value.pimpl->native_value)
+        return cache->write(max_decimal_places, value.pimpl->raw_numbers.get());
+
+    return stringify<rapidjson::Writer<rapidjson::StringBuffer>>(value.pimpl->native_value, max_decimal_places, value.pimpl->raw_numbers.get());
+}
+
+NJSON_INLINE bool FastWriter::write(const Value& value, std::ostream& output_stream, Compression compression)
+{
+    CompressStream stream(output_stream, compression);
+
+    if (!stream.isValid())
+        return false;
+
+    rapidjson::Writer<CompressStream> writer(stream);
+
+    if (max_decimal_places >= 0)
+        writer.SetMaxDecimalPlaces(max_decimal_places);
+    acceptValue(*value.pimpl->native_value, writer, value.pimpl->raw_numbers.get());
+
+    return stream.finish();
+}
+
+NJSON_INLINE std::string FastWriter::write(const std::vector<double>& numbers)
+{
+    return writeNumbers(numbers, max_decimal_places);
+}
+
+NJSON_INLINE std::string FastWriter::write(const std::vector<long long>& numbers)
+{
+    return writeNumbers(numbers, max_decimal_places);
+}
+
+/*******************************************************************************
+ * define ParallelWriter
+ ******************************************************************************/
+NJSON_INLINE ParallelWriter::ParallelWriter(unsigned int threads)
+    : threads(threads ? threads : std::max(std::thread::hardware_concurrency(), 1u))
+    , max_decimal_places(-1)
+    , pool(std::make_shared<WorkerPool>(this->threads))
+{
+}
+
+NJSON_INLINE void ParallelWriter::setMaxDecimalPlaces(int max_decimal_places)
+{
+    this->max_decimal_places = max_decimal_places;
+}
+
+NJSON_INLINE std::string ParallelWriter::write(const Value& value)
+{
+    std::vector<std::string> segments = writeSegments(value);
+    std::string output;
+    size_t size = 0;
+
+    for (const auto& segment : segments)
+        size += segment.size();
+
+    output.reserve(size);
+    for (const auto& segment : segments)
+        output += segment;
+
+    return output;
+}
+
+NJSON_INLINE bool ParallelWriter::write(const Value& value, std::ostream& output_stream, Compression compression)
+{
+    CompressStream stream(output_stream, compression);
+
+    if (!stream.isValid())
+        return false;
+
+    for (const auto& segment : writeSegments(value))
+        stream.write(segment.data(), segment.size());
+
+    return stream.finish();
+}
+
+NJSON_INLINE std::vector<std::string> ParallelWriter::writeSegments(const Value& value)
+{
+    const NativeValue& root = *value.pimpl->native_value;
+    const RawNumbers* raw_numbers = value.pimpl->raw_numbers.get();
+    std::unordered_map<const NativeValue*, size_t> weights;
+    size_t weight = (threads > 1 && (root.IsArray() || root.IsObject())) ? weightOf(root, &weights) : 0;
+    // several chunks for each thread so that a slow one is made up for
+    size_t limit = std::max(weight / (threads * 8), min_chunk_weight);
+    std::vector<std::string> output;
+
+    if (weight < limit * 2) {
+        output.emplace_back(stringify<rapidjson::Writer<rapidjson::StringBuffer>>(&root, max_decimal_places, raw_numbers));
+        return output;
+    }
+
+    std::vector<WriteSegment> segments;
+    std::vector<WriteSegment*> chunks;
+    std::atomic<size_t> next(0);
+
+    planSegments(root, limit, max_decimal_places, raw_numbers, weights, segments);
+    for (auto& segment : segments) {
+        if (segment.container)
+            chunks.push_back(&segment);
+    }
+
+    // chunks are taken in order by whichever thread is free
+    pool->run(chunks.size(), [&]() {
+        for (size_t index; (index = next++) < chunks.size();)
+            chunks[index]->encode(max_decimal_places, raw_numbers);
+    });
+
+    output.reserve(segments.size());
+    for (auto& segment : segments)
+        output.emplace_back(std::move(segment.text));
+
+    return output;
+}
+
+/*******************************************************************************
+ * define ParallelReader
+ ******************************************************************************/
+NJSON_INLINE ParallelReader::ParallelReader(unsigned int threads, NumberMode number_mode)
+    : threads(threads ? threads : std::max(std::thread::hardware_concurrency(), 1u))
+    , number_mode(number_mode)
+    , pool(std::make_shared<WorkerPool>(this->threads))
+{
+}
+
+NJSON_INLINE void ParallelReader::setInternTable(const InternTable& intern_table)
+{
+    this->intern_table = std::make_shared<InternTable>(intern_table);
+}
+
+// exceptions thrown by the workers, such as std::bad_alloc, are rethrown
+// once all of them have stopped
+NJSON_INLINE bool ParallelReader::parse(const std::string& data, Value& node)
+{
+    // below this a chunk is not worth a thread
+    const size_t min_chunk_size = 64 * 1024;
+    size_t chunk_size = std::max(data.size() / (threads * 4), min_chunk_size);
+    std::vector<std::pair<size_t, size_t>> chunks;
+
+    if (threads < 2 || data.size() < chunk_size * 2 || !splitArray(data, chunk_size, chunks) || chunks.size() < 2) {
+        Reader reader(number_mode);
+
+        if (intern_table)
+            reader.setInternTable(*intern_table);
+
+        if (!reader.parse(data, node))
+            return false;
+
+        // the elements of an earlier parse are not part of the tree anymore
+        node.pimpl->retained_allocators.clear();
+
+        return true;
+    }
+
+    // elements stay in the pools of the threads, the tree node belongs to gets
+    // a copy of them
+    if (!node.pimpl->raw_allocator) {
+        Value parsed;
+
+        if (!parse(data, parsed))
+            return false;
+
+        node = parsed;
+
+        return true;
+    }
+
+    size_t workers = std::min<size_t>(threads, chunks.size());
+    std::vector<std::shared_ptr<NativeAllocator>> pools;
+    std::vector<RawNumbers> texts(workers);
+    std::vector<NativeValue> results(chunks.size());
+    std::vector<char> succeeded(chunks.size());
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> next_worker(0);
+
+    for (size_t i = 0; i < workers; i++)
+        pools.push_back(std::make_shared<NativeAllocator>());
+
+    // each running thread takes a pool of its own
+    pool->run(workers, [&]() {
+        size_t worker = next_worker++;
+
+        for (size_t index; (index = next++) < chunks.size();)
+            succeeded[index] = parseElements(data, chunks[index], results[index], *pools[worker], number_mode, intern_table.get(), texts[worker]);
+    });
+
+    rapidjson::SizeType count = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (!succeeded[i])
+            return false;
+
+        count += results[i].Size();
+    }
+
+    NativeValue root(rapidjson::kArrayType);
+    NativeAllocator& allocator = *node.pimpl->allocator;
+
+    root.Reserve(count, allocator);
+    for (auto& elements : results) {
+        for (auto element = elements.Begin(); element != elements.End(); ++element)
+            root.PushBack(*element, allocator);
+    }
+
+    node.pimpl->native_value->Swap(root);
+    // replacing the pools of an earlier parse, whose elements were dropped
+    node.pimpl->retained_allocators.swap(pools);
+    node.pimpl->intern_table = intern_table;
+    node.pimpl->raw_numbers = nullptr;
+    if (number_mode == NumberMode::rawNumber) {
+        node.pimpl->raw_numbers = std::make_shared<RawNumbers>();
+        for (auto& worker_texts : texts)
+            node.pimpl->raw_numbers->merge(worker_texts);
+    }
+
+    node.pimpl->touch();
+
+    return true;
+}
+
+/*******************************************************************************
+ * define Builder
+ ******************************************************************************/
+NJSON_INLINE Builder::ObjectScope::ObjectScope(Builder& builder)
+    : builder(builder)
+{
+    builder.startObject();
+}
+
+NJSON_INLINE Builder::ObjectScope::ObjectScope(Builder& builder, StringView name)
+    : builder(builder)
+{
+    builder.key(name).startObject();
+}
+
+NJSON_INLINE Builder::ObjectScope::~ObjectScope()
+{
+    builder.endObject();
+}
+
+NJSON_INLINE Builder::ArrayScope::ArrayScope(Builder& builder)
+    : builder(builder)
+{
+    builder.startArray();
+}
+
+NJSON_INLINE Builder::ArrayScope::ArrayScope(Builder& builder, StringView name)
+    : builder(builder)
+{
+    builder.key(name).startArray();
+}
+
+NJSON_INLINE Builder::ArrayScope::~ArrayScope()
+{
+    builder.endArray();
+}
+
+NJSON_INLINE Builder::Builder()
+    : pimpl(std::make_shared<BuilderImpl>())
+{
+}
+
+NJSON_INLINE Builder::Builder(std::ostream& output_stream, Compression compression)
+    : pimpl(std::make_shared<BuilderImpl>(&output_stream, compression))
+{
+}
+
+NJSON_INLINE Builder& Builder::startObject()
+{
+    if (pimpl->startValue() && pimpl->checked(pimpl->writer.StartObject()))
+        pimpl->containers.push_back(rapidjson::kObjectType);
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::endObject()
+{
+    if (pimpl->endContainer(rapidjson::kObjectType) && pimpl->checked(pimpl->writer.EndObject()))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::startArray()
+{
+    if (pimpl->startValue() && pimpl->checked(pimpl->writer.StartArray()))
+        pimpl->containers.push_back(rapidjson::kArrayType);
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::endArray()
+{
+    if (pimpl->endContainer(rapidjson::kArrayType) && pimpl->checked(pimpl->writer.EndArray()))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::key(StringView name)
+{
+    if (pimpl->startKey())
+        pimpl->checked(pimpl->writer.Key(name.data() ? name.data() : "", static_cast<rapidjson::SizeType>(name.size())));
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::null()
+{
+    if (pimpl->startValue() && pimpl->checked(pimpl->writer.Null()))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::value(bool value)
+{
+    if (pimpl->startValue() && pimpl->checked(pimpl->writer.Bool(value)))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::value(int value)
+{
+    if (pimpl->startValue() && pimpl->checked(pimpl->writer.Int(value)))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::value(unsigned int value)
+{
+    if (pimpl->startValue() && pimpl->checked(pimpl->writer.Uint(value)))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::value(long long value)
+{
+    if (pimpl->startValue() && pimpl->checked(pimpl->writer.Int64(value)))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::value(unsigned long long value)
+{
+    if (pimpl->startValue() && pimpl->checked(pimpl->writer.Uint64(value)))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::value(double value)
+{
+    if (pimpl->startValue() && pimpl->checked(pimpl->writer.Double(value)))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::value(const char* value)
+{
+    if (!value)
+        return null();
+
+    return this->value(StringView(value, strlen(value)));
+}
+
+NJSON_INLINE Builder& Builder::value(const std::string& value)
+{
+    return this->value(StringView(value));
+}
+
+NJSON_INLINE Builder& Builder::value(StringView value)
+{
+    if (pimpl->startValue() && pimpl->checked(pimpl->writer.String(value.data() ? value.data() : "", static_cast<rapidjson::SizeType>(value.size()))))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE Builder& Builder::value(const Value& value)
+{
+    if (pimpl->startValue() && pimpl->checked(acceptValue(*value.pimpl->native_value, pimpl->writer, value.pimpl->raw_numbers.get())))
+        pimpl->endValue();
+
+    return *this;
+}
+
+NJSON_INLINE bool Builder::isValid() const
+{
+    return pimpl->valid;
+}
+
+NJSON_INLINE bool Builder::isComplete() const
+{
+    return pimpl->complete;
+}
+
+NJSON_INLINE void Builder::flush()
+{
+    pimpl->flush();
+}
+
+NJSON_INLINE std::string Builder::getString() const
+{
+    return std::string(pimpl->buffer.GetString(), pimpl->buffer.GetSize());
+}
+
+/*******************************************************************************
+ * define extras
+ ******************************************************************************/
+NJSON_INLINE bool isCompressionSupported(Compression compression)
+{
+    switch (compression) {
+    case noCompression:
+        return true;
+    case gzipCompression:
+#ifdef NJSON_WITH_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case zstdCompression:
+#ifdef NJSON_WITH_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    default:
+        return false;
+    }
+}
+
+NJSON_INLINE std::istream& operator>>(std::istream& input_stream, Value& value)
+{
+    DecompressStream stream(input_stream);
+    rapidjson::Document document;
+
+    document.ParseStream(stream);
+
+    if (!document.HasParseError() && stream.isValid())
+        value = Value::ValueArgs { &document, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+    return input_stream;
+}
+
+NJSON_INLINE bool detail::parseSlot(const std::string& data, const detail::Slot& root)
+{
+    SlotHandler handler(root);
+
+    return parseWith(data, handler, NumberMode::defaultNumber);
+}
+NJSON_END_CONFIG
+} // NJson
+
+#endif // __NJSON_INL_H__
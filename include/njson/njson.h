@@ -17,12 +17,55 @@
 #ifndef __NJSON_H__
 #define __NJSON_H__
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+// With NJSON_HEADER_ONLY the library is compiled into every translation unit
+// including this header, so that accessors like isNull() or asInt() can be
+// inlined. Such users do not link the njson library, but each of them also
+// includes RapidJSON, <thread> and the zlib and zstd headers enabled.
+#ifdef NJSON_HEADER_ONLY
+#define NJSON_INLINE inline
+#else
+#define NJSON_INLINE
+#endif
+
+// Header only users built with different compression support have different
+// definitions of the same inline functions. The configuration names an inline
+// namespace, so that they do not share symbols which differ between them. The
+// library keeps its symbols in NJson itself.
+#if !defined(NJSON_HEADER_ONLY)
+#define NJSON_BEGIN_CONFIG
+#define NJSON_END_CONFIG
+#else
+#if defined(NJSON_WITH_ZLIB) && defined(NJSON_WITH_ZSTD)
+#define NJSON_CONFIG header_only_zlib_zstd
+#elif defined(NJSON_WITH_ZLIB)
+#define NJSON_CONFIG header_only_zlib
+#elif defined(NJSON_WITH_ZSTD)
+#define NJSON_CONFIG header_only_zstd
+#else
+#define NJSON_CONFIG header_only
+#endif
+#define NJSON_BEGIN_CONFIG inline namespace NJSON_CONFIG {
+#define NJSON_END_CONFIG }
+#endif
 
 namespace NJson {
+NJSON_BEGIN_CONFIG
 
 using ArrayIndex = unsigned int;
 using LargestInt = long long;
@@ -32,6 +75,97 @@ enum ValueType {
     arrayValue
 };
 
+#if __cplusplus >= 201703L
+using StringView = std::string_view;
+#else
+// non-owning pointer and length, a subset of std::string_view for C++11
+class StringView {
+public:
+    StringView()
+        : string_data(nullptr)
+        , string_size(0)
+    {
+    }
+
+    StringView(const char* str)
+        : string_data(str)
+        , string_size(str ? strlen(str) : 0)
+    {
+    }
+
+    StringView(const char* str, size_t size)
+        : string_data(str)
+        , string_size(size)
+    {
+    }
+
+    StringView(const std::string& str)
+        : string_data(str.data())
+        , string_size(str.size())
+    {
+    }
+
+    const char* data() const { return string_data; }
+    size_t size() const { return string_size; }
+    size_t length() const { return string_size; }
+    bool empty() const { return string_size == 0; }
+    const char* begin() const { return string_data; }
+    const char* end() const { return string_data + string_size; }
+    char operator[](size_t pos) const { return string_data[pos]; }
+
+    int compare(StringView other) const
+    {
+        size_t size = string_size < other.string_size ? string_size : other.string_size;
+        int result = size ? memcmp(string_data, other.string_data, size) : 0;
+
+        if (result == 0 && string_size != other.string_size)
+            result = string_size < other.string_size ? -1 : 1;
+
+        return result;
+    }
+
+private:
+    const char* string_data;
+    size_t string_size;
+};
+
+inline bool operator==(StringView lhs, StringView rhs)
+{
+    return lhs.size() == rhs.size() && lhs.compare(rhs) == 0;
+}
+
+inline bool operator!=(StringView lhs, StringView rhs)
+{
+    return !(lhs == rhs);
+}
+
+inline bool operator<(StringView lhs, StringView rhs)
+{
+    return lhs.compare(rhs) < 0;
+}
+#endif
+
+// fullPrecisionNumber parses doubles exactly instead of the fast approximate
+// path. rawNumber keeps numbers as their source text, which is written as is
+// and converted when accessed with asInt(), asDouble() and so on. Such values
+// are numeric and asString() gives their text. Copied into a tree which was
+// not parsed along with them, they are converted to numbers.
+enum NumberMode {
+    defaultNumber = 0,
+    fullPrecisionNumber,
+    rawNumber
+};
+
+// Compression of json streams. The input is detected from its first bytes,
+// gzip and zstd are available when the library is built with zlib and zstd.
+enum Compression {
+    noCompression = 0,
+    gzipCompression,
+    zstdCompression
+};
+
+bool isCompressionSupported(Compression compression);
+
 class Value {
 public:
     using ArrayIndex = NJson::ArrayIndex;
@@ -59,19 +193,40 @@ public:
 public:
     Value();
     Value(const Value& other);
+    // takes over the tree of a root, leaving it null, and copies a view as
+    // the copy constructor does
+    Value(Value&& other);
     Value(ValueType type);
     Value(const std::string& str);
     Value(const char* str);
+    Value(StringView str);
     Value(bool value);
+    // arrays filled in one pass
+    Value(const std::vector<int>& values);
+    Value(const std::vector<unsigned int>& values);
+    Value(const std::vector<long long>& values);
+    Value(const std::vector<double>& values);
+    Value(const std::vector<std::string>& values);
+    Value(const int* first, const int* last);
+    Value(const unsigned int* first, const unsigned int* last);
+    Value(const long long* first, const long long* last);
+    Value(const double* first, const double* last);
+    Value(const std::string* first, const std::string* last);
 
     bool operator==(const Value& other) const;
-    Value operator[](const std::string& name);
-    const Value operator[](const std::string& name) const;
+    bool operator==(const std::string& str) const;
+    bool operator==(const char* str) const;
+    bool operator==(StringView str) const;
+    Value operator[](StringView name);
+    const Value operator[](StringView name) const;
     Value operator[](ArrayIndex index);
     const Value operator[](ArrayIndex index) const;
     Value& operator=(const Value& value);
+    Value& operator=(Value&& value);
     Value& operator=(ValueType type);
+    Value& operator=(const std::string& value);
     Value& operator=(const char* value);
+    Value& operator=(StringView value);
     Value& operator=(int value);
     Value& operator=(unsigned int value);
     Value& operator=(long long value);
@@ -83,7 +238,7 @@ public:
     ArrayIndex size() const;
     bool empty() const;
     bool isNull() const;
-    bool isMember(const std::string& name) const;
+    bool isMember(StringView name) const;
     bool isObject() const;
     bool isArray() const;
     bool isString() const;
@@ -92,6 +247,8 @@ public:
     bool isBool() const;
     const char* asCString() const;
     std::string asString() const;
+    // refers to the stored string without copying, empty if not a string
+    StringView asStringView() const;
     int asInt() const;
     unsigned int asUInt() const;
     long long asLargestInt() const;
@@ -99,16 +256,49 @@ public:
     float asFloat() const;
     double asDouble() const;
 
+    // elements of an array of numbers, or of integers, copied in one pass.
+    // false and empty if the value is not such an array. Numbers kept as text
+    // are converted like asDouble() does. The tree itself keeps one node per
+    // element, contiguous storage exists only in numbers.
+    bool getNumbers(std::vector<double>& numbers) const;
+    bool getNumbers(std::vector<long long>& numbers) const;
+
     Value::Iterator begin() const;
     Value::Iterator end() const;
     void swap(Value& other);
+    // capacity for size elements of an array or members of an object, null
+    // becomes an array and other values are left as they are
+    void reserve(ArrayIndex size);
+    // grows an array with null elements or shrinks it, null becomes an array
+    // and other values are left as they are
+    void resize(ArrayIndex size);
     void clear();
+    // keep the output of FastWriter for the subtrees left unchanged so that
+    // writing this value again only encodes what was modified through it or
+    // the values taken from it afterwards. Several threads may write or hash
+    // the value at once, but not while it is modified.
+    void trackChanges(bool enable = true);
+    // structural hash, independent of the order of members, equal values have
+    // the same hash. Hashes of containers are kept only while changes are
+    // tracked, otherwise the whole value is walked on every call since nothing
+    // tells when it changes. Copies are not tracked, so the keys stored by an
+    // unordered container are hashed in full, once when they are inserted.
+    size_t hash() const;
 
 private:
     friend class StyledWriter;
     friend class FastWriter;
+    friend class ParallelWriter;
     friend class Reader;
+    friend class ParallelReader;
+    friend class Path;
+    friend class ColumnExtractor;
+    friend class Builder;
     friend std::istream& operator>>(std::istream& input_stream, Value& value);
+    friend Value diff(const Value& from, const Value& to);
+    friend void applyPatch(Value& value, const Value& patch);
+    friend Value diffJsonPatch(const Value& from, const Value& to);
+    friend bool applyJsonPatch(Value& value, const Value& patch);
 
     struct ValueArgs;
     struct ValueImpl;
@@ -118,23 +308,689 @@ private:
     std::shared_ptr<ValueImpl> pimpl;
 };
 
+// Compiled query which accepts either a JSON Pointer (RFC 6901) such as
+// "/people/0/name" or a path expression such as "people[*].name".
+class Path {
+public:
+    Path(const std::string& expression);
+    Path(const char* expression);
+
+    bool isValid() const;
+    Value resolve(const Value& root) const;
+    std::vector<Value> select(const Value& root) const;
+
+private:
+    friend class Reader;
+    friend class JsonPatchLog;
+    friend bool applyJsonPatch(Value& value, const Value& patch);
+
+    struct PathImpl;
+
+    std::shared_ptr<PathImpl> pimpl;
+};
+
+// JSON Merge Patch (RFC 7396) which turns from into to. Members of to whose
+// value is null cannot be told apart from removed ones by a merge patch.
+Value diff(const Value& from, const Value& to);
+// merges patch into value in place
+void applyPatch(Value& value, const Value& patch);
+
+// JSON Patch (RFC 6902) of add, remove and replace operations turning from into to
+Value diffJsonPatch(const Value& from, const Value& to);
+// applies the operations of patch in order, false at the first one which
+// fails or whose test does not match, leaving value as it was
+bool applyJsonPatch(Value& value, const Value& patch);
+
+// Strings repeated across documents, such as keys, stored once and referred
+// to by the values parsed with the table instead of being copied into each of
+// them. Only strings longer than RapidJSON keeps inside a value are interned.
+// Values parsed with the table and their copies keep it alive, copies into a
+// tree without the table get strings of their own. It can be shared between
+// threads.
+class InternTable {
+public:
+    struct Stats {
+        size_t strings;
+        size_t references;
+        size_t stored_bytes;
+        // bytes the references would have taken as copies, less stored_bytes
+        size_t saved_bytes;
+    };
+
+    // string values up to max_value_length characters are interned as well as keys
+    InternTable(size_t max_value_length = 0);
+
+    StringView intern(StringView str);
+    size_t getMaxValueLength() const;
+    Stats getStats() const;
+
+private:
+    friend class Value;
+
+    struct InternTableImpl;
+
+    // whether str refers to a string stored in the table
+    bool owns(StringView str) const;
+
+    std::shared_ptr<InternTableImpl> pimpl;
+};
+
+// pulls members of every element of an array of objects into one column each
+class ColumnExtractor {
+public:
+    ColumnExtractor();
+
+    // each returns the index of the column added for the member key
+    size_t addDouble(StringView key);
+    size_t addInteger(StringView key);
+    size_t addString(StringView key);
+
+    // fails if value is not an array of objects, or if a member has another
+    // type than its column, leaving the columns empty
+    bool extract(const Value& value);
+
+    size_t getRows() const;
+    // rows where the member is null or missing hold 0 or an empty string
+    const std::vector<double>& getDoubles(size_t column) const;
+    const std::vector<long long>& getIntegers(size_t column) const;
+    const std::vector<std::string>& getStrings(size_t column) const;
+    const std::vector<bool>& getNulls(size_t column) const;
+    const std::vector<bool>& getMissing(size_t column) const;
+
+private:
+    struct ColumnExtractorImpl;
+
+    std::shared_ptr<ColumnExtractorImpl> pimpl;
+};
+
 class Reader {
 public:
+    Reader(NumberMode number_mode = defaultNumber);
+
+    // keys and short strings of the values parsed afterwards are taken from
+    // intern_table, which is also used for the members added to them later.
+    // A value copied into a tree kept without the table gets its own strings.
+    void setInternTable(const InternTable& intern_table);
+    bool parse(const std::string& data, Value& node);
+    // keep only the subtrees matching one of projection while parsing
+    bool parse(const std::string& data, Value& node, const std::vector<Path>& projection);
+    // array of numbers, or of integers, parsed into contiguous storage without
+    // building a tree
+    bool parse(const std::string& data, std::vector<double>& numbers);
+    bool parse(const std::string& data, std::vector<long long>& numbers);
+    // plain or compressed json, decompressed and parsed chunk by chunk
+    bool parse(std::istream& input_stream, Value& node);
+    bool parseFile(const std::string& path, Value& node);
+
+private:
+    class ProjectionHandler;
+
+    template <typename InputStream>
+    bool parseStream(InputStream& input_stream, Value& node);
+
+    NumberMode number_mode;
+    std::shared_ptr<InternTable> intern_table;
+};
+
+// threads kept by ParallelReader and ParallelWriter across their calls
+class WorkerPool;
+
+// Same result as Reader. Elements of a large top level array are parsed by
+// several threads, other documents are parsed as Reader does. The number of
+// threads defaults to the number of cores.
+class ParallelReader {
+public:
+    ParallelReader(unsigned int threads = 0, NumberMode number_mode = defaultNumber);
+
+    // same as Reader::setInternTable, the table is shared by the threads
+    void setInternTable(const InternTable& intern_table);
     bool parse(const std::string& data, Value& node);
+
+private:
+    unsigned int threads;
+    NumberMode number_mode;
+    std::shared_ptr<InternTable> intern_table;
+    std::shared_ptr<WorkerPool> pool;
 };
 
+// Doubles are written in the shortest form which round-trips unless the
+// number of decimal places is limited.
 class StyledWriter {
 public:
+    StyledWriter();
+
+    void setMaxDecimalPlaces(int max_decimal_places);
     std::string write(const Value& value);
+    // same as FastWriter::write to a stream
+    bool write(const Value& value, std::ostream& output_stream, Compression compression = noCompression);
+
+private:
+    int max_decimal_places;
 };
 
 class FastWriter {
 public:
+    FastWriter();
+
+    void setMaxDecimalPlaces(int max_decimal_places);
+    std::string write(const Value& value);
+    std::string write(const std::vector<double>& numbers);
+    std::string write(const std::vector<long long>& numbers);
+    // serialized and compressed chunk by chunk, fails if compression is not
+    // supported or output_stream fails
+    bool write(const Value& value, std::ostream& output_stream, Compression compression = noCompression);
+
+private:
+    int max_decimal_places;
+};
+
+// Same output as FastWriter, large arrays and objects are split into chunks
+// written by several threads. The number of threads defaults to the number of
+// cores, they are started by the first write and kept by the writer and its
+// copies.
+class ParallelWriter {
+public:
+    ParallelWriter(unsigned int threads = 0);
+
+    void setMaxDecimalPlaces(int max_decimal_places);
     std::string write(const Value& value);
+    // chunks are written one after another without being put together first,
+    // fails as FastWriter::write to a stream does
+    bool write(const Value& value, std::ostream& output_stream, Compression compression = noCompression);
+
+private:
+    std::vector<std::string> writeSegments(const Value& value);
+
+    unsigned int threads;
+    int max_decimal_places;
+    std::shared_ptr<WorkerPool> pool;
 };
 
+// writes json straight to a buffer, or to output_stream in chunks, without
+// building a tree. A call out of place (a value where a key is expected, a
+// mismatched end, anything after the root value) is ignored and makes
+// isValid() false, as do a NaN or infinite double and a failing output stream.
+class Builder {
+public:
+    // startObject() on construction and endObject() on destruction
+    class ObjectScope {
+    public:
+        explicit ObjectScope(Builder& builder);
+        ObjectScope(Builder& builder, StringView name);
+        ObjectScope(const ObjectScope&) = delete;
+        ObjectScope& operator=(const ObjectScope&) = delete;
+        ~ObjectScope();
+
+    private:
+        Builder& builder;
+    };
+
+    // startArray() on construction and endArray() on destruction
+    class ArrayScope {
+    public:
+        explicit ArrayScope(Builder& builder);
+        ArrayScope(Builder& builder, StringView name);
+        ArrayScope(const ArrayScope&) = delete;
+        ArrayScope& operator=(const ArrayScope&) = delete;
+        ~ArrayScope();
+
+    private:
+        Builder& builder;
+    };
+
+    Builder();
+    // isValid() is false from the start if compression is not supported
+    explicit Builder(std::ostream& output_stream, Compression compression = noCompression);
+
+    Builder& startObject();
+    Builder& endObject();
+    Builder& startArray();
+    Builder& endArray();
+    Builder& key(StringView name);
+    Builder& null();
+    Builder& value(bool value);
+    Builder& value(int value);
+    Builder& value(unsigned int value);
+    Builder& value(long long value);
+    Builder& value(unsigned long long value);
+    Builder& value(double value);
+    Builder& value(const char* value);
+    Builder& value(const std::string& value);
+    Builder& value(StringView value);
+    // copies the subtree of value as it is
+    Builder& value(const Value& value);
+
+    bool isValid() const;
+    // the root value is closed
+    bool isComplete() const;
+    // written to the output stream, if any, only in chunks until complete
+    void flush();
+    // not yet flushed to the output stream, if any
+    std::string getString() const;
+
+private:
+    struct BuilderImpl;
+
+    std::shared_ptr<BuilderImpl> pimpl;
+};
+
+// Struct binding: specialize Binding<T> with a static fields() that lists the
+// members, then use readStruct()/writeStruct() without building a Value.
+//
+//   namespace NJson {
+//   template <>
+//   struct Binding<Person> {
+//       template <typename Fields>
+//       static void fields(Fields& f)
+//       {
+//           f("name", &Person::name);
+//           f("age", &Person::age);
+//       }
+//   };
+//   }
+template <typename T>
+struct Binding;
+
+namespace detail {
+
+struct Scalar {
+    enum Kind {
+        nullKind,
+        boolKind,
+        intKind,
+        uintKind,
+        doubleKind,
+        stringKind
+    };
+
+    Kind kind;
+    bool boolean;
+    long long integer;
+    unsigned long long uinteger;
+    double number;
+    const char* string;
+    size_t length;
+};
+
+struct SlotType;
+
+struct Slot {
+    void* object;
+    const SlotType* type;
+};
+
+struct SlotType {
+    bool (*scalar)(void* object, const Scalar& value);
+    void (*start)(void* object);
+    void (*member)(void* object, const char* name, size_t length, Slot& slot);
+    void (*element)(void* object, Slot& slot);
+};
+
+bool parseSlot(const std::string& data, const Slot& root);
+
+template <typename T, typename Enable = void>
+struct Traits;
+
+template <typename T>
+Slot slotOf(T& object)
+{
+    return { &object, Traits<T>::type() };
+}
+
+template <typename T>
+struct Traits<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+    static bool scalar(void* object, const Scalar& value)
+    {
+        T& target = *static_cast<T*>(object);
+
+        switch (value.kind) {
+        case Scalar::nullKind:
+            return true;
+        case Scalar::intKind:
+            if (value.integer < static_cast<long long>(std::numeric_limits<T>::min())
+                || (value.integer > 0 && static_cast<unsigned long long>(value.integer) > static_cast<unsigned long long>(std::numeric_limits<T>::max())))
+                return false;
+
+            target = static_cast<T>(value.integer);
+            return true;
+        case Scalar::uintKind:
+            if (value.uinteger > static_cast<unsigned long long>(std::numeric_limits<T>::max()))
+                return false;
+
+            target = static_cast<T>(value.uinteger);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static const SlotType* type()
+    {
+        static const SlotType slot_type { scalar, nullptr, nullptr, nullptr };
+
+        return &slot_type;
+    }
+
+    static void write(Builder& builder, const T& object)
+    {
+        if (std::is_signed<T>::value)
+            builder.value(static_cast<long long>(object));
+        else
+            builder.value(static_cast<unsigned long long>(object));
+    }
+};
+
+template <typename T>
+struct Traits<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static bool scalar(void* object, const Scalar& value)
+    {
+        T& target = *static_cast<T*>(object);
+
+        switch (value.kind) {
+        case Scalar::nullKind:
+            return true;
+        case Scalar::intKind:
+            target = static_cast<T>(value.integer);
+            return true;
+        case Scalar::uintKind:
+            target = static_cast<T>(value.uinteger);
+            return true;
+        case Scalar::doubleKind:
+            target = static_cast<T>(value.number);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static const SlotType* type()
+    {
+        static const SlotType slot_type { scalar, nullptr, nullptr, nullptr };
+
+        return &slot_type;
+    }
+
+    static void write(Builder& builder, const T& object)
+    {
+        builder.value(static_cast<double>(object));
+    }
+};
+
+template <>
+struct Traits<bool> {
+    static bool scalar(void* object, const Scalar& value)
+    {
+        if (value.kind == Scalar::boolKind)
+            *static_cast<bool*>(object) = value.boolean;
+
+        return value.kind == Scalar::boolKind || value.kind == Scalar::nullKind;
+    }
+
+    static const SlotType* type()
+    {
+        static const SlotType slot_type { scalar, nullptr, nullptr, nullptr };
+
+        return &slot_type;
+    }
+
+    static void write(Builder& builder, const bool& object)
+    {
+        builder.value(object);
+    }
+};
+
+template <>
+struct Traits<std::string> {
+    static bool scalar(void* object, const Scalar& value)
+    {
+        if (value.kind == Scalar::stringKind)
+            static_cast<std::string*>(object)->assign(value.string, value.length);
+
+        return value.kind == Scalar::stringKind || value.kind == Scalar::nullKind;
+    }
+
+    static const SlotType* type()
+    {
+        static const SlotType slot_type { scalar, nullptr, nullptr, nullptr };
+
+        return &slot_type;
+    }
+
+    static void write(Builder& builder, const std::string& object)
+    {
+        builder.value(object);
+    }
+};
+
+template <typename T>
+struct Traits<std::vector<T>> {
+    static void start(void* object)
+    {
+        static_cast<std::vector<T>*>(object)->clear();
+    }
+
+    static void element(void* object, Slot& slot)
+    {
+        auto items = static_cast<std::vector<T>*>(object);
+
+        items->emplace_back();
+        slot = slotOf(items->back());
+    }
+
+    static const SlotType* type()
+    {
+        static const SlotType slot_type { nullptr, start, nullptr, element };
+
+        return &slot_type;
+    }
+
+    static void write(Builder& builder, const std::vector<T>& object)
+    {
+        builder.startArray();
+        for (const auto& item : object)
+            Traits<T>::write(builder, item);
+        builder.endArray();
+    }
+};
+
+// elements of std::vector<bool> are bits, each is appended by its scalar
+template <>
+struct Traits<std::vector<bool>> {
+    static bool scalar(void* object, const Scalar& value)
+    {
+        if (value.kind != Scalar::boolKind && value.kind != Scalar::nullKind)
+            return false;
+
+        static_cast<std::vector<bool>*>(object)->push_back(value.kind == Scalar::boolKind && value.boolean);
+
+        return true;
+    }
+
+    static void start(void* object)
+    {
+        static_cast<std::vector<bool>*>(object)->clear();
+    }
+
+    static void element(void* object, Slot& slot)
+    {
+        static const SlotType element_type { scalar, nullptr, nullptr, nullptr };
+
+        slot = { object, &element_type };
+    }
+
+    static const SlotType* type()
+    {
+        static const SlotType slot_type { nullptr, start, nullptr, element };
+
+        return &slot_type;
+    }
+
+    static void write(Builder& builder, const std::vector<bool>& object)
+    {
+        builder.startArray();
+        for (bool item : object)
+            builder.value(item);
+        builder.endArray();
+    }
+};
+
+template <typename T, typename Enable>
+struct Traits {
+    // a member of T whatever its type, the member pointer is kept as bytes
+    // and given back its type by the functions instantiated for it
+    struct Field {
+        std::string name;
+        char member[sizeof(char T::*)];
+        Slot (*slot)(const Field& field, T& object);
+        void (*write)(const Field& field, Builder& builder, const T& object);
+    };
+
+    template <typename M>
+    static M T::*memberOf(const Field& field)
+    {
+        M T::*member;
+
+        memcpy(&member, field.member, sizeof(member));
+
+        return member;
+    }
+
+    template <typename M>
+    static Slot slotOfField(const Field& field, T& object)
+    {
+        return slotOf(object.*memberOf<M>(field));
+    }
+
+    template <typename M>
+    static void writeField(const Field& field, Builder& builder, const T& object)
+    {
+        Traits<M>::write(builder, object.*memberOf<M>(field));
+    }
+
+    struct Collector {
+        template <typename M>
+        void operator()(const char* name, M T::*member)
+        {
+            static_assert(sizeof(member) == sizeof(char T::*), "member pointers of T differ in size");
+
+            Field field { name, {}, slotOfField<M>, writeField<M> };
+
+            memcpy(field.member, &member, sizeof(member));
+            fields.push_back(field);
+        }
+
+        std::vector<Field> fields;
+    };
+
+    // in the order of Binding<T>::fields(), which they are written in
+    static const std::vector<Field>& fields()
+    {
+        static const std::vector<Field> table = [] {
+            Collector collector;
+
+            Binding<T>::fields(collector);
+
+            return collector.fields;
+        }();
+
+        return table;
+    }
+
+    // fields sorted by name, looked up by a binary search
+    static const std::vector<const Field*>& index()
+    {
+        static const std::vector<const Field*> table = [] {
+            std::vector<const Field*> names;
+
+            for (const auto& field : fields())
+                names.push_back(&field);
+            std::sort(names.begin(), names.end(), [](const Field* a, const Field* b) {
+                return StringView(a->name) < StringView(b->name);
+            });
+
+            return names;
+        }();
+
+        return table;
+    }
+
+    static void member(void* object, const char* name, size_t length, Slot& slot)
+    {
+        const auto& names = index();
+        StringView key(name, length);
+        auto found = std::lower_bound(names.begin(), names.end(), key, [](const Field* field, StringView key) {
+            return StringView(field->name) < key;
+        });
+
+        // unknown member is skipped
+        if (found == names.end() || StringView((*found)->name) != key)
+            slot = { nullptr, nullptr };
+        else
+            slot = (*found)->slot(**found, *static_cast<T*>(object));
+    }
+
+    static const SlotType* type()
+    {
+        static const SlotType slot_type { nullptr, nullptr, member, nullptr };
+
+        return &slot_type;
+    }
+
+    static void write(Builder& builder, const T& object)
+    {
+        builder.startObject();
+        for (const auto& field : fields()) {
+            builder.key(field.name);
+            field.write(field, builder, object);
+        }
+        builder.endObject();
+    }
+};
+
+} // detail
+
+// members missing from data keep their values. Parsing goes straight into
+// object, when it fails the members read before the error keep what was read.
+template <typename T>
+bool readStruct(const std::string& data, T& object)
+{
+    return detail::parseSlot(data, detail::slotOf(object));
+}
+
+template <typename T>
+void writeStruct(Builder& builder, const T& object)
+{
+    detail::Traits<T>::write(builder, object);
+}
+
+template <typename T>
+std::string writeStruct(const T& object)
+{
+    Builder builder;
+
+    writeStruct(builder, object);
+
+    return builder.getString();
+}
+
 std::istream& operator>>(std::istream& input_stream, Value& value);
 
+NJSON_END_CONFIG
+} // NJson
+
+namespace std {
+// walks the whole value unless its changes are tracked, see Value::hash()
+template <>
+struct hash<NJson::Value> {
+    size_t operator()(const NJson::Value& value) const
+    {
+        return value.hash();
+    }
 };
+}
+
+#ifdef NJSON_HEADER_ONLY
+#include "njson-inl.h"
+#endif
 
 #endif // __NJSON_H__
@@ -15,10 +15,63 @@
  */
 
 #include <fstream>
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
 #include <gtest/gtest.h>
 
 #include "njson/njson.h"
 
+struct Building {
+    std::string location;
+    bool hq;
+};
+
+struct Company {
+    std::string company;
+    std::vector<Building> building;
+    std::vector<int> scores;
+    double rate;
+};
+
+struct Switches {
+    std::vector<bool> states;
+};
+
+namespace NJson {
+template <>
+struct Binding<Building> {
+    template <typename Fields>
+    static void fields(Fields& f)
+    {
+        f("location", &Building::location);
+        f("hq", &Building::hq);
+    }
+};
+
+template <>
+struct Binding<Company> {
+    template <typename Fields>
+    static void fields(Fields& f)
+    {
+        f("company", &Company::company);
+        f("building", &Company::building);
+        f("scores", &Company::scores);
+        f("rate", &Company::rate);
+    }
+};
+
+template <>
+struct Binding<Switches> {
+    template <typename Fields>
+    static void fields(Fields& f)
+    {
+        f("states", &Switches::states);
+    }
+};
+}
+
 #define MEMBER_JSON_STRING "{\"company\": \"skt\",\"building\": [{\"location\": \"seoul\",\"hq\": true},{\"location\": \"busan\",\"hq\": false}]}"
 #define DEFAULT_JSON_STRING "{\"count\":2,\"people\":[{\"name\":\"jean\"},{\"name\":\"kim\"}]}"
 #define EMPTY_JSON_STRING "{}"
@@ -80,7 +133,7 @@ TEST(njsonTest, MakeSimpleArray)
     }
 
     jarray = jvalue["array"];
-    ASSERT_EQ(jarray.size(), 10);
+    ASSERT_EQ(jarray.size(), 10u);
 
     for (NJson::ArrayIndex i = 0; i < jarray.size(); i++) {
         const NJson::Value& jitem = jarray[i];
@@ -100,8 +153,8 @@ TEST(njsonTest, MakeArrayByIndex)
     value["orders"][1] = "second";
     value["internals"][0]["type"] = "basic";
 
-    ASSERT_EQ(value["items"].size(), 3);
-    ASSERT_EQ(value["orders"].size(), 2);
+    ASSERT_EQ(value["items"].size(), 3u);
+    ASSERT_EQ(value["orders"].size(), 2u);
     ASSERT_EQ(value["items"][0].asString(), "item_1");
     ASSERT_EQ(value["orders"][1].asString(), "second");
     ASSERT_EQ(value["internals"][0]["type"].asString(), "basic");
@@ -131,7 +184,7 @@ TEST(njsonTest, DefaultParsing)
     ASSERT_TRUE(reader.parse(DEFAULT_JSON_STRING, root));
 
     ASSERT_EQ(root["count"].asInt(), 2);
-    ASSERT_EQ(root["people"].size(), 2);
+    ASSERT_EQ(root["people"].size(), 2u);
 }
 
 TEST(njsonTest, ParsingAndCheckMember)
@@ -213,7 +266,7 @@ TEST(njsonTest, CheckKeyAndGetValue)
 
     ASSERT_TRUE(!root["people"].empty());
     ASSERT_TRUE(root["people"].isArray());
-    ASSERT_EQ(root["people"].size(), 2);
+    ASSERT_EQ(root["people"].size(), 2u);
 
     NJson::Value jean;
     jean = root["people"][0];
@@ -349,7 +402,7 @@ TEST(njsonTest, ConstructValue)
 
     ASSERT_TRUE(array_value.isArray());
     ASSERT_TRUE(!array_value.empty());
-    ASSERT_EQ(array_value.size(), 2);
+    ASSERT_EQ(array_value.size(), 2u);
 
     // construct value by deep copy
     std::string original_value_str = writer.write(array_value);
@@ -359,7 +412,7 @@ TEST(njsonTest, ConstructValue)
     ASSERT_TRUE(array_value.empty());
     ASSERT_EQ(writer.write(array_value), "[]");
     ASSERT_TRUE(!copied_value.empty());
-    ASSERT_EQ(copied_value.size(), 2);
+    ASSERT_EQ(copied_value.size(), 2u);
     ASSERT_EQ(writer.write(copied_value), original_value_str);
 }
 
@@ -401,3 +454,1165 @@ TEST(njsonTest, ClearValue)
         ASSERT_TRUE(value.empty());
     }
 }
+
+TEST(njsonTest, QueryByJsonPointer)
+{
+    const auto DATA = "{\"a/b\":1,\"m~n\":2,\"list\":[{\"name\":\"jean\"},{\"name\":\"kim\"}],\"\":3}";
+
+    NJson::Value root;
+    NJson::Reader reader;
+
+    ASSERT_TRUE(reader.parse(DATA, root));
+
+    ASSERT_EQ(NJson::Path("/list/1/name").resolve(root).asString(), "kim");
+    ASSERT_EQ(NJson::Path("/a~1b").resolve(root).asInt(), 1);
+    ASSERT_EQ(NJson::Path("/m~0n").resolve(root).asInt(), 2);
+    ASSERT_EQ(NJson::Path("/").resolve(root).asInt(), 3);
+    ASSERT_TRUE(NJson::Path("").resolve(root) == root);
+    ASSERT_TRUE(NJson::Path("/list/2/name").resolve(root).isNull());
+    ASSERT_TRUE(NJson::Path("/list/01").resolve(root).isNull());
+    ASSERT_TRUE(!NJson::Path("/a~2b").isValid());
+
+    // resolved value refers to the original node
+    NJson::Path("/list/0/name").resolve(root) = "lee";
+    ASSERT_EQ(root["list"][0]["name"].asString(), "lee");
+}
+
+TEST(njsonTest, QueryByPathExpression)
+{
+    NJson::Value root;
+    NJson::Reader reader;
+
+    ASSERT_TRUE(reader.parse(MEMBER_JSON_STRING, root));
+
+    NJson::Path location("building[1].location");
+    NJson::Path all_locations("$.building[*].location");
+
+    ASSERT_TRUE(location.isValid());
+    ASSERT_EQ(location.resolve(root).asString(), "busan");
+    ASSERT_EQ(NJson::Path("building.0['hq']").resolve(root).asBool(), true);
+
+    auto locations = all_locations.select(root);
+    ASSERT_EQ(locations.size(), 2u);
+    ASSERT_EQ(locations[0].asString(), "seoul");
+    ASSERT_EQ(locations[1].asString(), "busan");
+    ASSERT_EQ(all_locations.resolve(root).asString(), "seoul");
+
+    ASSERT_EQ(NJson::Path("building[0].*").select(root).size(), 2u);
+    ASSERT_TRUE(NJson::Path("company[0]").select(root).empty());
+    ASSERT_TRUE(!NJson::Path("building[x]").isValid());
+    ASSERT_TRUE(!NJson::Path("building..hq").isValid());
+}
+
+TEST(njsonTest, ReadAndWriteStruct)
+{
+    const auto DATA = "{\"company\":\"skt\",\"building\":[{\"location\":\"seoul\",\"hq\":true},{\"location\":\"busan\",\"hq\":false}],\"scores\":[1,2,3],\"rate\":0.5}";
+
+    Company company {};
+
+    ASSERT_TRUE(NJson::readStruct(MEMBER_JSON_STRING, company));
+    ASSERT_EQ(company.company, "skt");
+    ASSERT_EQ(company.building.size(), 2u);
+    ASSERT_EQ(company.building[0].location, "seoul");
+    ASSERT_TRUE(company.building[0].hq);
+    ASSERT_EQ(company.building[1].location, "busan");
+    ASSERT_TRUE(!company.building[1].hq);
+
+    company.scores = { 1, 2, 3 };
+    company.rate = 0.5;
+    ASSERT_EQ(NJson::writeStruct(company), DATA);
+
+    // same output as building a Value and writing it
+    NJson::Value root;
+    NJson::Reader reader;
+    NJson::FastWriter writer;
+
+    ASSERT_TRUE(reader.parse(DATA, root));
+    ASSERT_EQ(writer.write(root), NJson::writeStruct(company));
+
+    // unknown members are skipped and mismatched types are rejected
+    Building building {};
+
+    ASSERT_TRUE(NJson::readStruct("{\"extra\":{\"a\":[1,{}]},\"location\":\"ulsan\",\"hq\":null}", building));
+    ASSERT_EQ(building.location, "ulsan");
+    ASSERT_TRUE(!NJson::readStruct("{\"location\":1}", building));
+    ASSERT_TRUE(!NJson::readStruct("{\"scores\":[1,\"2\"]}", company));
+    ASSERT_TRUE(!NJson::readStruct("{\"building\":{}}", company));
+    ASSERT_TRUE(!NJson::readStruct("{\"company\":", company));
+
+    // a failed parse keeps what was read before the error
+    ASSERT_TRUE(!NJson::readStruct("{\"company\":\"kt\",\"scores\":[4,\"5\"],\"rate\":1.5}", company));
+    ASSERT_EQ(company.company, "kt");
+    ASSERT_EQ(company.rate, 0.5);
+
+    Switches switches {};
+
+    ASSERT_TRUE(NJson::readStruct("{\"states\":[true,false,true]}", switches));
+    ASSERT_EQ(switches.states, std::vector<bool>({ true, false, true }));
+    ASSERT_EQ(NJson::writeStruct(switches), "{\"states\":[true,false,true]}");
+}
+
+TEST(njsonTest, ParseWithProjection)
+{
+    const auto DATA = "{\"id\":7,\"meta\":{\"owner\":{\"name\":\"kim\",\"age\":30},\"tags\":[\"a\",\"b\"]},"
+                      "\"items\":[{\"id\":1,\"price\":1.5,\"skip\":[1,2,{\"x\":\"]}\"}]},{\"id\":2}],\"large\":[[1],[2],[3]]}";
+
+    NJson::Value root;
+    NJson::Reader reader;
+    NJson::FastWriter writer;
+
+    ASSERT_TRUE(reader.parse(DATA, root, { "id", "/meta/owner/name", "items[*].id", "large[2]" }));
+    ASSERT_EQ(writer.write(root), "{\"id\":7,\"meta\":{\"owner\":{\"name\":\"kim\"}},\"items\":[{\"id\":1},{\"id\":2}],\"large\":[null,null,[3]]}");
+
+    // projected paths resolve the same as on the full document
+    NJson::Value full;
+
+    ASSERT_TRUE(reader.parse(DATA, full));
+    ASSERT_TRUE(NJson::Path("items[1].id").resolve(root) == NJson::Path("items[1].id").resolve(full));
+
+    ASSERT_TRUE(reader.parse(DATA, root, { "meta.tags" }));
+    ASSERT_EQ(writer.write(root), "{\"meta\":{\"tags\":[\"a\",\"b\"]}}");
+
+    ASSERT_TRUE(reader.parse(DATA, root, { "none" }));
+    ASSERT_EQ(writer.write(root), "{}");
+
+    // syntax errors in skipped parts are still reported and keep the node
+    ASSERT_TRUE(!reader.parse("{\"id\":1,\"skip\":[1,}", root, { "id" }));
+    ASSERT_EQ(writer.write(root), "{}");
+
+    // kept strings are interned like with the other overloads
+    NJson::InternTable intern_table(32);
+    NJson::Reader interning_reader;
+
+    interning_reader.setInternTable(intern_table);
+    ASSERT_TRUE(interning_reader.parse(R"({"device_identifier":"speaker-living-room","skipped_identifier":"x"})", root,
+        { "device_identifier" }));
+    ASSERT_EQ(writer.write(root), R"({"device_identifier":"speaker-living-room"})");
+    ASSERT_EQ(intern_table.getStats().strings, 2u);
+    ASSERT_EQ(intern_table.getStats().references, 2u);
+}
+
+TEST(njsonTest, HandleNumberModes)
+{
+    const auto DATA = "{\"int\":12,\"large\":21474836470,\"double\":0.30000000000000004,\"negative\":-3}";
+
+    NJson::Value root;
+    NJson::Reader reader;
+    NJson::Reader raw_reader(NJson::rawNumber);
+    NJson::Reader precise_reader(NJson::fullPrecisionNumber);
+
+    // integers are converted by asDouble() and asFloat()
+    ASSERT_TRUE(reader.parse(DATA, root));
+    ASSERT_EQ(root["int"].asDouble(), 12.0);
+    ASSERT_EQ(root["large"].asDouble(), 21474836470.0);
+    ASSERT_EQ(root["negative"].asFloat(), -3.0f);
+
+    ASSERT_TRUE(precise_reader.parse(DATA, root));
+    ASSERT_EQ(root["double"].asDouble(), 0.30000000000000004);
+
+    // raw numbers stay as text until accessed
+    ASSERT_TRUE(raw_reader.parse(DATA, root));
+    ASSERT_TRUE(root["large"].isNumeric());
+    ASSERT_TRUE(!root["large"].isString());
+    ASSERT_EQ(root["large"].asString(), "21474836470");
+    ASSERT_EQ(root["large"].asLargestInt(), 21474836470LL);
+    ASSERT_EQ(root["large"].asInt(), 0);
+    ASSERT_EQ(root["int"].asInt(), 12);
+    ASSERT_EQ(root["int"].asUInt(), 12u);
+    ASSERT_EQ(root["negative"].asUInt(), 0u);
+    ASSERT_EQ(root["double"].asDouble(), 0.30000000000000004);
+
+    ASSERT_TRUE(raw_reader.parse(DATA, root, { "int" }));
+    ASSERT_EQ(root["int"].asString(), "12");
+
+    // raw numbers are written as they were read
+    NJson::FastWriter writer;
+
+    ASSERT_TRUE(raw_reader.parse("{\"a\":1.50,\"b\":[2,3e0],\"c\":\"4\"}", root));
+    ASSERT_EQ(writer.write(root), "{\"a\":1.50,\"b\":[2,3e0],\"c\":\"4\"}");
+    ASSERT_EQ(NJson::StyledWriter().write(root["b"]), "[\n    2,\n    3e0\n]");
+
+    // strings are not taken for numbers
+    ASSERT_EQ(root["c"].asInt(), 0);
+    ASSERT_TRUE(root["c"].isString());
+
+    NJson::Value text;
+
+    text = "42";
+    ASSERT_EQ(text.asInt(), 0);
+    text = " 7";
+    ASSERT_EQ(text.asLargestInt(), 0);
+    text = "inf";
+    ASSERT_EQ(text.asDouble(), 0.0);
+
+    // copies share the texts when they can, otherwise get numbers
+    NJson::Value copied;
+    NJson::Value other;
+
+    copied = root["b"];
+
+    ASSERT_EQ(writer.write(copied), "[2,3e0]");
+    ASSERT_TRUE(raw_reader.parse("{\"x\":1}", other));
+    other["y"] = root["a"];
+    other["z"].append(root["b"][0]);
+    root = NJson::Value();
+    ASSERT_EQ(writer.write(other), "{\"x\":1,\"y\":1.5,\"z\":[2]}");
+    ASSERT_EQ(other["y"].asDouble(), 1.5);
+    ASSERT_EQ(copied[0].asInt(), 2);
+    ASSERT_EQ(copied[1].asDouble(), 3.0);
+}
+
+TEST(njsonTest, WriteShortestNumber)
+{
+    NJson::Value value;
+    NJson::FastWriter writer;
+
+    value["float"] = 3.14f;
+    value["double"] = 0.1;
+    ASSERT_EQ(writer.write(value), "{\"float\":3.14,\"double\":0.1}");
+    ASSERT_EQ(value["float"].asFloat(), 3.14f);
+
+    value["double"] = 1.0 / 3;
+    writer.setMaxDecimalPlaces(3);
+    ASSERT_EQ(writer.write(value), "{\"float\":3.14,\"double\":0.333}");
+
+    // floats are kept as the shortest decimal converting back to them
+    const float floats[] = { 0.1f, -2.5f, 1e-7f, 9.999999e9f, 16777216.0f, 3.4028235e38f, 1.17549435e-38f };
+    const double shortest[] = { 0.1, -2.5, 1e-7, 9.999999e9, 16777216.0, 3.4028235e38, 1.1754944e-38 };
+
+    for (int i = 0; i < 7; i++) {
+        value["float"] = floats[i];
+        ASSERT_EQ(value["float"].asDouble(), shortest[i]);
+        ASSERT_EQ(value["float"].asFloat(), floats[i]);
+    }
+
+    // rounded from the float itself rather than from its 9 digits
+    value["float"] = 8.8835545e-16f;
+    ASSERT_EQ(value["float"].asDouble(), 8.883554e-16);
+    for (int i = 0; i < 10000; i++) {
+        float number = i * 0.37f - 1e3f;
+
+        value["float"] = number;
+        ASSERT_EQ(value["float"].asFloat(), number);
+    }
+}
+
+TEST(njsonTest, AccessStringView)
+{
+    const std::string key_with_nul("a\0b", 3);
+    const std::string text_with_nul("x\0y\0z", 5);
+
+    NJson::Value root;
+    NJson::Reader reader;
+
+    ASSERT_TRUE(reader.parse(DEFAULT_JSON_STRING, root));
+
+    NJson::StringView name = root["people"][1]["name"].asStringView();
+    ASSERT_EQ(name.size(), 3u);
+    ASSERT_TRUE(name == "kim");
+    ASSERT_TRUE(root["people"][1]["name"] == "kim");
+    ASSERT_TRUE(root["people"][1]["name"] == std::string("kim"));
+    ASSERT_TRUE(root["people"][1]["name"] == name);
+    ASSERT_TRUE(!(root["people"][1]["name"] == "ki"));
+    ASSERT_TRUE(!(root["count"] == "2"));
+    ASSERT_TRUE(root["count"].asStringView().empty());
+    ASSERT_TRUE(root.isMember(NJson::StringView("people")));
+
+    // embedded NUL is kept in keys and values
+    root[key_with_nul] = NJson::StringView(text_with_nul);
+    ASSERT_TRUE(root.isMember(key_with_nul));
+    ASSERT_TRUE(!root.isMember("a"));
+    ASSERT_EQ(root[key_with_nul].asStringView().size(), 5u);
+    ASSERT_EQ(root[key_with_nul].asString(), text_with_nul);
+    ASSERT_EQ(NJson::Value(text_with_nul).asStringView().size(), 5u);
+    ASSERT_EQ(NJson::Value(std::string("x\0y", 3)).asString(), std::string("x\0y", 3));
+
+    root["text"] = std::string("value");
+    ASSERT_EQ(root["text"].asString(), "value");
+}
+
+TEST(njsonTest, TrackChanges)
+{
+    NJson::Value root;
+    NJson::FastWriter writer;
+
+    for (int i = 0; i < 20; i++) {
+        NJson::Value device;
+
+        device["id"] = i;
+        device["name"] = "device-" + std::to_string(i);
+        device["status"]["power"] = true;
+        device["status"]["volume"] = 10;
+        device["tags"].append("speaker").append("living room");
+        root["devices"].append(device);
+    }
+    root["version"] = "1.0";
+
+    // writes of a deep copy are never cached
+    auto expect = [&](NJson::Value& value) {
+        NJson::Value copied(value);
+        ASSERT_EQ(writer.write(value), writer.write(copied));
+    };
+
+    root.trackChanges();
+    expect(root);
+    expect(root);
+
+    root["devices"][3]["status"]["volume"] = 11;
+    expect(root);
+
+    for (auto device : root["devices"])
+        device["name"] = "renamed";
+    expect(root);
+
+    root["devices"][5]["tags"].append("kitchen");
+    root["devices"][7]["tags"].clear();
+    expect(root);
+
+    NJson::Value first = root["devices"][0];
+    NJson::Value last = root["devices"][19];
+    first.swap(last);
+    expect(root);
+
+    NJson::Path("devices[*].status.power").resolve(root) = false;
+    for (auto& power : NJson::Path("devices[*].status.power").select(root))
+        power = 1;
+    expect(root);
+
+    root["devices"][30]["id"] = 30;
+    root["added"] = "member";
+    expect(root);
+
+    NJson::Reader reader;
+    NJson::Value parsed = root["devices"][2];
+    ASSERT_TRUE(reader.parse(DEFAULT_JSON_STRING, parsed));
+    expect(root);
+
+    writer.setMaxDecimalPlaces(2);
+    root["version"] = 1.2345;
+    expect(root);
+
+    // a cached container emptied and written, then filled again
+    NJson::Value device = root["devices"][9];
+    NJson::Value big;
+    for (int i = 0; i < 20; i++)
+        big["member-" + std::to_string(i)] = i;
+    device.clear();
+    expect(root);
+    device["big"] = big;
+    expect(root);
+
+    // the same tree written by several threads
+    std::vector<std::thread> threads;
+    std::vector<std::string> outputs(4);
+    NJson::Value copied(root);
+    for (size_t i = 0; i < outputs.size(); i++)
+        threads.emplace_back([&, i]() {
+            NJson::FastWriter thread_writer;
+            outputs[i] = thread_writer.write(root);
+            root.hash();
+        });
+    for (auto& thread : threads)
+        thread.join();
+    for (const auto& output : outputs)
+        ASSERT_EQ(output, NJson::FastWriter().write(copied));
+
+    root.trackChanges(false);
+    root["devices"][4]["id"] = 44;
+    expect(root);
+}
+
+TEST(njsonTest, DiffAndApplyPatch)
+{
+    NJson::Reader reader;
+    NJson::FastWriter writer;
+    NJson::Value original;
+    NJson::Value patch;
+    NJson::Value expected;
+
+    // example of RFC 7396
+    ASSERT_TRUE(reader.parse(R"({"title":"Goodbye!","author":{"givenName":"John","familyName":"Doe"},)"
+                             R"("tags":["example","sample"],"content":"This will be unchanged"})",
+        original));
+    ASSERT_TRUE(reader.parse(R"({"title":"Hello!","phoneNumber":"+01-555-555-5555","author":{"familyName":null},"tags":["example"]})", patch));
+    ASSERT_TRUE(reader.parse(R"({"title":"Hello!","author":{"givenName":"John"},"tags":["example"],)"
+                             R"("content":"This will be unchanged","phoneNumber":"+01-555-555-5555"})",
+        expected));
+
+    NJson::Value value(original);
+    NJson::applyPatch(value, patch);
+    ASSERT_EQ(writer.write(value), writer.write(expected));
+
+    NJson::Value merge_patch = NJson::diff(original, expected);
+    ASSERT_EQ(writer.write(merge_patch), R"({"title":"Hello!","author":{"familyName":null},"tags":["example"],"phoneNumber":"+01-555-555-5555"})");
+    ASSERT_EQ(writer.write(NJson::diff(expected, expected)), "{}");
+
+    value = original;
+    value.trackChanges();
+    writer.write(value);
+    NJson::applyPatch(value, merge_patch);
+    ASSERT_TRUE(value == expected);
+    ASSERT_EQ(writer.write(value), writer.write(expected));
+
+    NJson::Value json_patch = NJson::diffJsonPatch(original, expected);
+    ASSERT_EQ(writer.write(json_patch), R"([{"op":"replace","path":"/title","value":"Hello!"},)"
+                                        R"({"op":"remove","path":"/author/familyName"},)"
+                                        R"({"op":"remove","path":"/tags/1"},)"
+                                        R"({"op":"add","path":"/phoneNumber","value":"+01-555-555-5555"}])");
+
+    value = original;
+    ASSERT_TRUE(NJson::applyJsonPatch(value, json_patch));
+    ASSERT_TRUE(value == expected);
+
+    NJson::Value operations;
+    ASSERT_TRUE(reader.parse(R"([{"op":"add","path":"/tags/0","value":"first"},)"
+                             R"({"op":"add","path":"/tags/-","value":"last"},)"
+                             R"({"op":"copy","from":"/title","path":"/a~1b"},)"
+                             R"({"op":"move","from":"/content","path":"/author/content"},)"
+                             R"({"op":"test","path":"/tags/1","value":"example"}])",
+        operations));
+    ASSERT_TRUE(NJson::applyJsonPatch(value, operations));
+    ASSERT_EQ(writer.write(value), R"({"title":"Hello!","author":{"givenName":"John","content":"This will be unchanged"},)"
+                                   R"("tags":["first","example","last"],"phoneNumber":"+01-555-555-5555","a/b":"Hello!"})");
+
+    ASSERT_TRUE(reader.parse(R"([{"op":"test","path":"/title","value":"Goodbye!"}])", operations));
+    ASSERT_FALSE(NJson::applyJsonPatch(value, operations));
+    ASSERT_TRUE(reader.parse(R"([{"op":"remove","path":"/missing"}])", operations));
+    ASSERT_FALSE(NJson::applyJsonPatch(value, operations));
+    ASSERT_TRUE(reader.parse(R"([{"op":"move","from":"/author","path":"/author/inner"}])", operations));
+    ASSERT_FALSE(NJson::applyJsonPatch(value, operations));
+
+    // a failed operation leaves value as it was, also a tracked one
+    std::string before = writer.write(value);
+    value.trackChanges();
+    writer.write(value);
+    ASSERT_TRUE(reader.parse(R"([{"op":"remove","path":"/tags/0"},{"op":"add","path":"/x","value":1},)"
+                             R"({"op":"test","path":"/title","value":"Goodbye!"}])",
+        operations));
+    ASSERT_FALSE(NJson::applyJsonPatch(value, operations));
+    ASSERT_EQ(writer.write(value), before);
+    ASSERT_TRUE(reader.parse(R"([{"op":"remove","path":"/author/givenName"},{"op":"move","from":"/title","path":"/tags/1"},)"
+                             R"({"op":"replace","path":"/tags/0","value":0},{"op":"copy","from":"/author","path":"/a~1b"},)"
+                             R"({"op":"remove","path":""},{"op":"remove","path":"/missing"}])",
+        operations));
+    ASSERT_FALSE(NJson::applyJsonPatch(value, operations));
+    ASSERT_EQ(writer.write(value), before);
+
+    // the tree is patched in place, views into it stay attached and repeated
+    // patches do not copy it
+    NJson::Value tags = value["tags"];
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(reader.parse(R"([{"op":"replace","path":"/title","value":)" + std::to_string(i) + "}]", operations));
+        ASSERT_TRUE(NJson::applyJsonPatch(value, operations));
+    }
+    tags.append("appended");
+    ASSERT_EQ(value["title"].asInt(), 999);
+    ASSERT_EQ(value["tags"][3].asString(), "appended");
+    ASSERT_TRUE(reader.parse(R"([{"op":"remove","path":"/tags/3"}])", operations));
+    ASSERT_TRUE(NJson::applyJsonPatch(value, operations));
+    ASSERT_TRUE(reader.parse(R"([{"op":"replace","path":"/title","value":"Hello!"}])", operations));
+    ASSERT_TRUE(NJson::applyJsonPatch(value, operations));
+    ASSERT_EQ(writer.write(value), before);
+
+    // into a value which belongs to another tree
+    NJson::Value root;
+    root["child"] = value;
+    NJson::Value child = root["child"];
+    ASSERT_TRUE(reader.parse(R"([{"op":"remove","path":"/tags/0"},{"op":"replace","path":"/title","value":"Bye"}])", operations));
+    ASSERT_TRUE(NJson::applyJsonPatch(child, operations));
+    ASSERT_TRUE(NJson::applyJsonPatch(value, operations));
+    ASSERT_EQ(writer.write(root["child"]), writer.write(value));
+    ASSERT_EQ(value["title"].asString(), "Bye");
+}
+
+TEST(njsonTest, HashAndCompare)
+{
+    NJson::Reader reader;
+    NJson::Value value;
+    NJson::Value reordered;
+
+    ASSERT_TRUE(reader.parse(R"({"name":"njson","tags":["a","b"],"size":{"x":1,"y":2.5},"empty":{}})", value));
+    ASSERT_TRUE(reader.parse(R"({"size":{"y":2.5,"x":1.0},"empty":{},"tags":["a","b"],"name":"njson"})", reordered));
+    ASSERT_TRUE(value == reordered);
+    ASSERT_EQ(value.hash(), reordered.hash());
+
+    reordered["tags"][0] = "b";
+    reordered["tags"][1] = "a";
+    ASSERT_FALSE(value == reordered);
+    ASSERT_NE(value.hash(), reordered.hash());
+
+    // cached hashes follow changes
+    NJson::Value tracked(value);
+    tracked.trackChanges();
+    ASSERT_EQ(tracked.hash(), value.hash());
+
+    NJson::Value size = tracked["size"];
+    size["x"] = 3;
+    ASSERT_EQ(tracked.hash(), NJson::Value(tracked).hash());
+    ASSERT_NE(tracked.hash(), value.hash());
+    ASSERT_FALSE(tracked == value);
+
+    tracked["tags"].clear();
+    tracked["tags"].append("a").append("b");
+    size["x"] = 1;
+    ASSERT_EQ(tracked.hash(), value.hash());
+    ASSERT_TRUE(tracked == value);
+
+    std::unordered_set<NJson::Value> documents;
+    documents.insert(value);
+    documents.insert(reordered);
+    documents.insert(tracked);
+    ASSERT_EQ(documents.size(), 2u);
+    ASSERT_EQ(documents.count(value), 1u);
+}
+
+TEST(njsonTest, WriteInParallel)
+{
+    NJson::Value root;
+    NJson::FastWriter writer;
+
+    for (int i = 0; i < 3000; i++) {
+        NJson::Value record;
+
+        record["id"] = i;
+        record["name"] = "record \"" + std::to_string(i) + "\"\n";
+        record["ratio"] = i / 7.0;
+        record["tags"].append("x").append(i % 2 == 0);
+        root["records"].append(record);
+    }
+
+    for (int i = 0; i < 2000; i++)
+        root["lookup"]["key/" + std::to_string(i)] = i * 3;
+    root["empty"] = NJson::Value(NJson::ValueType::arrayValue);
+    root["small"]["value"] = 1;
+
+    std::string expected = writer.write(root);
+
+    for (unsigned int threads : { 1, 2, 4, 7 }) {
+        NJson::ParallelWriter parallel_writer(threads);
+        std::ostringstream output_stream;
+
+        ASSERT_EQ(parallel_writer.write(root), expected);
+        ASSERT_TRUE(parallel_writer.write(root, output_stream));
+        ASSERT_EQ(output_stream.str(), expected);
+    }
+
+    NJson::ParallelWriter parallel_writer;
+    parallel_writer.setMaxDecimalPlaces(2);
+    writer.setMaxDecimalPlaces(2);
+    ASSERT_EQ(parallel_writer.write(root), writer.write(root));
+    ASSERT_EQ(parallel_writer.write(root["records"][0]), writer.write(root["records"][0]));
+    ASSERT_EQ(parallel_writer.write(NJson::Value("text")), "\"text\"");
+
+    // the threads of a writer are kept, also for its copies used at once
+    NJson::ParallelWriter shared_writer(4);
+    std::vector<std::thread> threads;
+    std::vector<std::string> outputs(3);
+    writer.setMaxDecimalPlaces(-1);
+    for (size_t i = 0; i < outputs.size(); i++)
+        threads.emplace_back([&, i]() {
+            NJson::ParallelWriter copied_writer(shared_writer);
+            for (int repeat = 0; repeat < 5; repeat++)
+                outputs[i] = copied_writer.write(root);
+        });
+    for (auto& thread : threads)
+        thread.join();
+    for (const auto& output : outputs)
+        ASSERT_EQ(output, expected);
+}
+
+TEST(njsonTest, ParseInParallel)
+{
+    std::string data = "[";
+
+    for (int i = 0; i < 4000; i++) {
+        if (i)
+            data += i % 3 ? "," : " ,\n ";
+
+        data += R"({"id":)" + std::to_string(i) + R"(,"text":"a,b]c[d{e}f\"g\\","unicode":"],",)"
+            + R"("nested":[[1,2],{"k":"]"}],"escaped":"\\\\\"","ratio":)" + std::to_string(i) + ".25}";
+        if (i % 100 == 0)
+            data += R"(,"plain, \"string\"",[],{},null,true,12345678901234567890)";
+    }
+    data += "]\n";
+
+    NJson::Reader reader;
+    NJson::FastWriter writer;
+    NJson::Value expected;
+
+    ASSERT_TRUE(reader.parse(data, expected));
+
+    for (unsigned int threads : { 1, 2, 4, 7 }) {
+        NJson::ParallelReader parallel_reader(threads);
+        NJson::Value value;
+
+        ASSERT_TRUE(parallel_reader.parse(data, value));
+        ASSERT_EQ(value.size(), expected.size());
+        ASSERT_EQ(writer.write(value), writer.write(expected));
+    }
+
+    // into a value which belongs to another tree
+    NJson::ParallelReader parallel_reader(4);
+    NJson::Value root;
+    NJson::Value child = root["child"];
+
+    ASSERT_TRUE(parallel_reader.parse(data, child));
+    ASSERT_EQ(writer.write(root["child"]), writer.write(expected));
+
+    NJson::ParallelReader raw_reader(4, NJson::NumberMode::rawNumber);
+    NJson::Value raw;
+    ASSERT_TRUE(raw_reader.parse(data, raw));
+    ASSERT_EQ(raw[0]["ratio"].asString(), "0.25");
+    ASSERT_EQ(raw[7]["ratio"].asDouble(), 1.25);
+    ASSERT_EQ(writer.write(raw), writer.write(expected));
+    ASSERT_TRUE(raw_reader.parse(data, child));
+    ASSERT_EQ(writer.write(root["child"]), writer.write(expected));
+
+    // the same errors as Reader
+    std::string invalid = data;
+    invalid.insert(invalid.size() - 2, ",");
+    ASSERT_FALSE(parallel_reader.parse(invalid, root));
+    ASSERT_FALSE(parallel_reader.parse(data.substr(0, data.size() - 2), root));
+    ASSERT_FALSE(parallel_reader.parse(data.substr(0, data.size() - 2) + "}", root));
+    ASSERT_FALSE(parallel_reader.parse(data + "]", root));
+
+    invalid = data;
+    invalid.replace(invalid.find("\"id\":3000"), 4, "\"id\" 3000");
+    ASSERT_FALSE(parallel_reader.parse(invalid, root));
+    ASSERT_EQ(writer.write(root["child"]), writer.write(expected));
+
+    ASSERT_TRUE(parallel_reader.parse(R"({"object":[1,2]})", root));
+    ASSERT_EQ(root["object"][1].asInt(), 2);
+
+    // parsing again releases the pools of the elements parsed before
+    NJson::Value reparsed;
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(parallel_reader.parse(data, reparsed));
+        ASSERT_EQ(writer.write(reparsed), writer.write(expected));
+    }
+    ASSERT_TRUE(parallel_reader.parse(R"([1,2])", reparsed));
+    ASSERT_EQ(writer.write(reparsed), "[1,2]");
+    ASSERT_TRUE(parallel_reader.parse(data, reparsed));
+    ASSERT_EQ(writer.write(reparsed), writer.write(expected));
+
+    // strings are interned whether the document is split or not
+    NJson::InternTable intern_table(32);
+    NJson::ParallelReader interning_reader(4);
+    NJson::Value interned;
+
+    interning_reader.setInternTable(intern_table);
+    ASSERT_TRUE(interning_reader.parse(R"({"device_identifier":"speaker-living-room"})", interned));
+    ASSERT_EQ(intern_table.getStats().references, 2u);
+    ASSERT_EQ(intern_table.getStats().strings, 2u);
+
+    ASSERT_TRUE(interning_reader.parse(R"([{"device_identifier":"speaker-living-room"},)" + data.substr(1), interned));
+    ASSERT_EQ(writer.write(interned[0]), R"({"device_identifier":"speaker-living-room"})");
+    // keys and repeated values are stored once for all the threads
+    ASSERT_LT(intern_table.getStats().strings, 10u);
+    ASSERT_GT(intern_table.getStats().references, 4000u);
+    ASSERT_EQ(writer.write(interned[1]), writer.write(expected[0]));
+}
+
+TEST(njsonTest, InternStrings)
+{
+    const std::string document = R"({"device_identifier":"speaker-living-room","ts":1,)"
+                                 R"("status":"online","description":"a string longer than the limit of the table"})";
+    std::vector<NJson::Value> values(100);
+    NJson::InternTable intern_table(32);
+
+    {
+        NJson::Reader reader;
+
+        reader.setInternTable(intern_table);
+        for (auto& value : values)
+            ASSERT_TRUE(reader.parse(document, value));
+    }
+
+    ASSERT_EQ(values[99]["device_identifier"].asString(), "speaker-living-room");
+    ASSERT_EQ(values[0]["device_identifier"].asCString(), values[99]["device_identifier"].asCString());
+    ASSERT_NE(values[0]["description"].asCString(), values[99]["description"].asCString());
+    ASSERT_NE(values[0]["status"].asCString(), values[99]["status"].asCString());
+
+    // "device_identifier" and "speaker-living-room", the other strings are
+    // short enough to be kept inside the values
+    NJson::InternTable::Stats stats = intern_table.getStats();
+    ASSERT_EQ(stats.strings, 2u);
+    ASSERT_EQ(stats.references, 200u);
+    ASSERT_EQ(stats.stored_bytes, 18u + 20u);
+    ASSERT_EQ(stats.saved_bytes, 99u * (18u + 20u));
+
+    values[0]["added_member_name"] = 1;
+    values[1]["added_member_name"] = 2;
+    ASSERT_EQ(intern_table.getStats().strings, 3u);
+    ASSERT_EQ(intern_table.getStats().references, 202u);
+
+    // the table stays alive as long as the values refer to it
+    NJson::Value copied;
+    {
+        NJson::InternTable scoped_table;
+        NJson::Reader reader;
+        NJson::Value parsed;
+
+        reader.setInternTable(scoped_table);
+        ASSERT_TRUE(reader.parse(document, parsed));
+        copied = parsed;
+    }
+    ASSERT_EQ(copied["device_identifier"].asString(), "speaker-living-room");
+    ASSERT_TRUE(copied.isMember("description"));
+
+    // trees which cannot keep the table get copies of its strings
+    NJson::FastWriter writer;
+    NJson::Value root;
+    NJson::Value other_table;
+    NJson::InternTable other(32);
+    std::string patch;
+    {
+        NJson::InternTable scoped_table(32);
+        NJson::Reader reader;
+        NJson::Value parsed;
+
+        reader.setInternTable(other);
+        ASSERT_TRUE(reader.parse(R"({"unrelated":1})", other_table));
+        reader.setInternTable(scoped_table);
+        ASSERT_TRUE(reader.parse(document, parsed));
+
+        root["copied"] = parsed;
+        root["appended"].append(parsed);
+        other_table["copied"] = parsed;
+
+        // a patch keeps the table of the value it was made from
+        NJson::Value merge_patch = NJson::diff(NJson::Value(), parsed);
+        NJson::Value patched = root["patched"];
+        NJson::applyPatch(patched, merge_patch);
+        NJson::Value json_patched = root["json_patched"];
+        ASSERT_TRUE(NJson::applyJsonPatch(json_patched, NJson::diffJsonPatch(NJson::Value(), parsed)));
+        patch = writer.write(merge_patch);
+    }
+    const std::string expected = writer.write(copied);
+
+    ASSERT_EQ(patch, expected);
+    ASSERT_EQ(writer.write(root["copied"]), expected);
+    ASSERT_EQ(writer.write(root["appended"][0]), expected);
+    ASSERT_EQ(writer.write(other_table["copied"]), expected);
+    ASSERT_EQ(writer.write(root["patched"]), expected);
+    ASSERT_EQ(writer.write(root["json_patched"]), expected);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&intern_table, &document]() {
+            NJson::Reader reader;
+            NJson::Value value;
+
+            reader.setInternTable(intern_table);
+            for (int j = 0; j < 100; j++)
+                reader.parse(document, value);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    ASSERT_EQ(intern_table.getStats().strings, 3u);
+    ASSERT_EQ(intern_table.getStats().references, 202u + 800u);
+}
+
+TEST(njsonTest, BuildArraysInBulk)
+{
+    NJson::FastWriter writer;
+    std::vector<int> ints { -1, 0, 1 };
+    std::vector<long long> large { 1LL << 40, -(1LL << 40) };
+    std::vector<std::string> strings { "a", "b\"c" };
+    double doubles[] = { 0.5, 1.25, 3 };
+
+    ASSERT_EQ(writer.write(NJson::Value(ints)), "[-1,0,1]");
+    ASSERT_EQ(writer.write(NJson::Value(std::vector<unsigned int> { 4000000000u })), "[4000000000]");
+    ASSERT_EQ(writer.write(NJson::Value(large)), "[1099511627776,-1099511627776]");
+    ASSERT_EQ(writer.write(NJson::Value(strings)), "[\"a\",\"b\\\"c\"]");
+    ASSERT_EQ(writer.write(NJson::Value(std::begin(doubles), std::end(doubles))), "[0.5,1.25,3.0]");
+    ASSERT_EQ(writer.write(NJson::Value(std::vector<double>())), "[]");
+
+    NJson::Value root;
+    root["values"] = NJson::Value(ints.data() + 1, ints.data() + ints.size());
+    ASSERT_EQ(writer.write(root), "{\"values\":[0,1]}");
+
+    NJson::Value array;
+    array.reserve(100);
+    ASSERT_TRUE(array.isArray());
+    ASSERT_EQ(array.size(), 0u);
+
+    array.resize(3);
+    ASSERT_EQ(writer.write(array), "[null,null,null]");
+    array[5] = 5;
+    ASSERT_EQ(writer.write(array), "[null,null,null,null,null,5]");
+    array.resize(1);
+    ASSERT_EQ(writer.write(array), "[null]");
+
+    root.reserve(10);
+    root["name"] = "njson";
+    ASSERT_EQ(writer.write(root), "{\"values\":[0,1],\"name\":\"njson\"}");
+    root.resize(3);
+    ASSERT_EQ(writer.write(root), "{\"values\":[0,1],\"name\":\"njson\"}");
+
+    NJson::Value text = "text";
+    text.reserve(3);
+    text.resize(3);
+    ASSERT_EQ(text.asString(), "text");
+}
+
+TEST(njsonTest, HandleNumberArrays)
+{
+    NJson::Reader reader;
+    NJson::FastWriter writer;
+    std::vector<double> doubles;
+    std::vector<long long> integers;
+
+    ASSERT_TRUE(reader.parse("[1, -2.5, 3e2, 18446744073709551615]", doubles));
+    ASSERT_EQ(doubles, (std::vector<double> { 1, -2.5, 300, 18446744073709551615.0 }));
+    ASSERT_TRUE(reader.parse("[ ]", doubles));
+    ASSERT_TRUE(doubles.empty());
+
+    ASSERT_TRUE(reader.parse("[1, -9007199254740993, 4294967296]", integers));
+    ASSERT_EQ(integers, (std::vector<long long> { 1, -9007199254740993LL, 4294967296LL }));
+    ASSERT_EQ(writer.write(integers), "[1,-9007199254740993,4294967296]");
+
+    ASSERT_FALSE(reader.parse("[1, 2.5]", integers));
+    ASSERT_TRUE(integers.empty());
+    ASSERT_FALSE(reader.parse("[1, [2]]", doubles));
+    ASSERT_FALSE(reader.parse("[1, \"2\"]", doubles));
+    ASSERT_FALSE(reader.parse("{\"a\":1}", doubles));
+    ASSERT_FALSE(reader.parse("1", doubles));
+
+    NJson::Reader raw_reader(NJson::NumberMode::rawNumber);
+    ASSERT_TRUE(raw_reader.parse("[0.1, 2, 12345678901234567890]", doubles));
+    ASSERT_EQ(doubles, (std::vector<double> { 0.1, 2, 12345678901234567890.0 }));
+    ASSERT_TRUE(raw_reader.parse("[-5, 9223372036854775807]", integers));
+    ASSERT_EQ(integers.back(), 9223372036854775807LL);
+
+    NJson::Value value;
+    ASSERT_TRUE(reader.parse("{\"samples\":[0.5,1,2.25],\"ids\":[3,4],\"mixed\":[1,null]}", value));
+    ASSERT_TRUE(value["samples"].getNumbers(doubles));
+    ASSERT_EQ(doubles, (std::vector<double> { 0.5, 1, 2.25 }));
+    ASSERT_TRUE(value["ids"].getNumbers(integers));
+    ASSERT_EQ(integers, (std::vector<long long> { 3, 4 }));
+    ASSERT_FALSE(value["samples"].getNumbers(integers));
+    ASSERT_FALSE(value["mixed"].getNumbers(doubles));
+    ASSERT_TRUE(doubles.empty());
+
+    // numbers kept as text are converted as asDouble() does, but not strings
+    ASSERT_TRUE(raw_reader.parse("{\"samples\":[0.1,2,-7],\"texts\":[\"1\"]}", value));
+    ASSERT_TRUE(value["samples"].getNumbers(doubles));
+    ASSERT_EQ(doubles, (std::vector<double> { 0.1, 2, -7 }));
+    ASSERT_FALSE(value["samples"].getNumbers(integers));
+    ASSERT_FALSE(value["texts"].getNumbers(doubles));
+    ASSERT_TRUE(raw_reader.parse("[2,-7]", value));
+    ASSERT_TRUE(value.getNumbers(integers));
+    ASSERT_EQ(integers, (std::vector<long long> { 2, -7 }));
+
+    doubles = { 0.5, 1, 1.0 / 3 };
+    ASSERT_EQ(writer.write(doubles), writer.write(NJson::Value(doubles)));
+    writer.setMaxDecimalPlaces(2);
+    ASSERT_EQ(writer.write(doubles), "[0.5,1.0,0.33]");
+}
+
+TEST(njsonTest, ExtractColumns)
+{
+    NJson::Reader reader;
+    NJson::Value value;
+    NJson::ColumnExtractor extractor;
+
+    ASSERT_TRUE(reader.parse("["
+                             "{\"id\":1,\"name\":\"first\",\"score\":0.5},"
+                             "{\"id\":2,\"name\":null,\"score\":3},"
+                             "{\"score\":1.25,\"id\":3},"
+                             "{\"id\":4,\"name\":\"fourth\",\"score\":null,\"extra\":true}"
+                             "]",
+        value));
+
+    size_t id = extractor.addInteger("id");
+    size_t name = extractor.addString("name");
+    size_t score = extractor.addDouble("score");
+
+    ASSERT_TRUE(extractor.extract(value));
+    ASSERT_EQ(extractor.getRows(), 4u);
+    ASSERT_EQ(extractor.getIntegers(id), (std::vector<long long> { 1, 2, 3, 4 }));
+    ASSERT_EQ(extractor.getStrings(name), (std::vector<std::string> { "first", "", "", "fourth" }));
+    ASSERT_EQ(extractor.getNulls(name), (std::vector<bool> { false, true, false, false }));
+    ASSERT_EQ(extractor.getMissing(name), (std::vector<bool> { false, false, true, false }));
+    ASSERT_EQ(extractor.getDoubles(score), (std::vector<double> { 0.5, 3, 1.25, 0 }));
+    ASSERT_EQ(extractor.getNulls(score), (std::vector<bool> { false, false, false, true }));
+    ASSERT_TRUE(extractor.getDoubles(id).empty());
+    ASSERT_TRUE(extractor.getNulls(10).empty());
+
+    // the same columns are extracted again from another array
+    ASSERT_TRUE(reader.parse("[{\"id\":5}]", value));
+    ASSERT_TRUE(extractor.extract(value));
+    ASSERT_EQ(extractor.getRows(), 1u);
+    ASSERT_EQ(extractor.getIntegers(id), (std::vector<long long> { 5 }));
+    ASSERT_EQ(extractor.getMissing(score), (std::vector<bool> { true }));
+
+    ASSERT_TRUE(reader.parse("[{\"id\":1},{\"id\":\"2\"}]", value));
+    ASSERT_FALSE(extractor.extract(value));
+    ASSERT_EQ(extractor.getRows(), 0u);
+    ASSERT_TRUE(extractor.getIntegers(id).empty());
+    ASSERT_TRUE(reader.parse("[{\"id\":1.5}]", value));
+    ASSERT_FALSE(extractor.extract(value));
+    ASSERT_TRUE(reader.parse("[{\"id\":1},2]", value));
+    ASSERT_FALSE(extractor.extract(value));
+    ASSERT_TRUE(reader.parse("{\"id\":1}", value));
+    ASSERT_FALSE(extractor.extract(value));
+
+    // numbers kept as text by NumberMode::rawNumber
+    NJson::Reader raw_reader(NJson::NumberMode::rawNumber);
+    NJson::ColumnExtractor raw_extractor;
+    size_t x = raw_extractor.addDouble("x");
+    size_t n = raw_extractor.addInteger("n");
+    size_t text = raw_extractor.addString("text");
+
+    ASSERT_TRUE(raw_reader.parse(R"([{"x":1.5,"n":7,"text":"a"},{"x":2,"n":-1,"text":"2"}])", value));
+    ASSERT_TRUE(raw_extractor.extract(value));
+    ASSERT_EQ(raw_extractor.getDoubles(x), (std::vector<double> { 1.5, 2 }));
+    ASSERT_EQ(raw_extractor.getIntegers(n), (std::vector<long long> { 7, -1 }));
+    ASSERT_EQ(raw_extractor.getStrings(text), (std::vector<std::string> { "a", "2" }));
+    ASSERT_TRUE(raw_reader.parse(R"([{"x":1,"n":1.5}])", value));
+    ASSERT_FALSE(raw_extractor.extract(value));
+    ASSERT_TRUE(raw_reader.parse(R"([{"text":3}])", value));
+    ASSERT_FALSE(raw_extractor.extract(value));
+}
+
+TEST(njsonTest, BuildWithScopes)
+{
+    NJson::Value embedded;
+    NJson::Reader reader;
+
+    ASSERT_TRUE(reader.parse("{\"tags\":[\"a\",\"b\"],\"size\":2}", embedded));
+
+    NJson::Builder builder;
+    {
+        NJson::Builder::ObjectScope root(builder);
+        builder.key("id").value(7);
+        {
+            NJson::Builder::ArrayScope items(builder, "items");
+            builder.value("first").null().value(embedded["tags"]);
+        }
+        builder.key("meta").value(embedded);
+        ASSERT_FALSE(builder.isComplete());
+    }
+    ASSERT_TRUE(builder.isValid());
+    ASSERT_TRUE(builder.isComplete());
+    ASSERT_EQ(builder.getString(), "{\"id\":7,\"items\":[\"first\",null,[\"a\",\"b\"]],\"meta\":{\"tags\":[\"a\",\"b\"],\"size\":2}}");
+
+    // calls out of place are ignored
+    NJson::Builder value_for_key;
+    value_for_key.startObject().value(1);
+    ASSERT_FALSE(value_for_key.isValid());
+    value_for_key.key("a").value(1).endObject();
+    ASSERT_EQ(value_for_key.getString(), "{");
+
+    NJson::Builder mismatched;
+    mismatched.startArray().endObject();
+    ASSERT_FALSE(mismatched.isValid());
+
+    NJson::Builder key_in_array;
+    key_in_array.startArray().key("a");
+    ASSERT_FALSE(key_in_array.isValid());
+
+    NJson::Builder after_root;
+    after_root.value(1);
+    ASSERT_TRUE(after_root.isComplete());
+    after_root.value(2);
+    ASSERT_FALSE(after_root.isValid());
+    ASSERT_EQ(after_root.getString(), "1");
+
+    // values the writer refuses and stream errors make the output invalid
+    NJson::Builder not_a_number;
+    not_a_number.startObject().key("a").value(std::numeric_limits<double>::quiet_NaN()).endObject();
+    ASSERT_FALSE(not_a_number.isValid());
+    ASSERT_FALSE(not_a_number.isComplete());
+
+    NJson::Value infinite;
+    infinite["b"] = std::numeric_limits<double>::infinity();
+    NJson::Builder embedding_infinity;
+    embedding_infinity.value(infinite);
+    ASSERT_FALSE(embedding_infinity.isValid());
+    ASSERT_FALSE(embedding_infinity.isComplete());
+
+    std::ostringstream failing;
+    failing.setstate(std::ios::badbit);
+    NJson::Builder failing_stream(failing);
+    failing_stream.startArray().endArray();
+    ASSERT_FALSE(failing_stream.isValid());
+
+    std::ostringstream output;
+    {
+        NJson::Builder streaming(output);
+        NJson::Builder::ArrayScope root(streaming);
+
+        for (int i = 0; i < 20000; i++)
+            streaming.value(i);
+        ASSERT_FALSE(output.str().empty());
+    }
+
+    std::string expected = "[";
+    for (int i = 0; i < 20000; i++)
+        expected += (i ? "," : "") + std::to_string(i);
+    ASSERT_EQ(output.str(), expected + "]");
+}
+
+TEST(njsonTest, StreamCompressedJson)
+{
+    NJson::Reader reader;
+    NJson::FastWriter writer;
+    NJson::Value value;
+    NJson::Value parsed;
+
+    for (int i = 0; i < 20000; i++) {
+        value["items"][i]["id"] = i;
+        value["items"][i]["name"] = "item" + std::to_string(i);
+    }
+    std::string expected = writer.write(value);
+
+    std::ostringstream plain;
+    ASSERT_TRUE(writer.write(value, plain));
+    ASSERT_EQ(plain.str(), expected);
+
+    std::istringstream plain_input(plain.str());
+    ASSERT_TRUE(reader.parse(plain_input, parsed));
+    ASSERT_EQ(writer.write(parsed), expected);
+    // the state of the stream is left to the caller
+    ASSERT_EQ(plain_input.rdstate(), std::ios::goodbit);
+
+    if (NJson::isCompressionSupported(NJson::gzipCompression)) {
+        std::ostringstream gzip;
+        ASSERT_TRUE(writer.write(value, gzip, NJson::gzipCompression));
+        ASSERT_EQ(gzip.str().substr(0, 2), "\x1f\x8b");
+        ASSERT_LT(gzip.str().size(), expected.size());
+
+        std::istringstream gzip_input(gzip.str());
+        ASSERT_TRUE(reader.parse(gzip_input, parsed));
+        ASSERT_EQ(writer.write(parsed), expected);
+        ASSERT_EQ(gzip_input.rdstate(), std::ios::goodbit);
+
+        NJson::Value streamed;
+        std::istringstream gzip_stream(gzip.str());
+        gzip_stream >> streamed;
+        ASSERT_EQ(writer.write(streamed), expected);
+
+        std::istringstream truncated(gzip.str().substr(0, gzip.str().size() / 2));
+        ASSERT_FALSE(reader.parse(truncated, parsed));
+        ASSERT_EQ(truncated.rdstate(), std::ios::goodbit);
+    }
+
+    // nothing is read from a stream which failed already
+    std::istringstream failed(expected);
+    failed.setstate(std::ios::failbit);
+    ASSERT_FALSE(reader.parse(failed, parsed));
+    ASSERT_EQ(failed.rdstate(), std::ios::failbit);
+
+    std::ostringstream zstd;
+    ASSERT_EQ(writer.write(value, zstd, NJson::zstdCompression), NJson::isCompressionSupported(NJson::zstdCompression));
+    if (NJson::isCompressionSupported(NJson::zstdCompression)) {
+        ASSERT_EQ(zstd.str().substr(0, 4), "\x28\xb5\x2f\xfd");
+        ASSERT_LT(zstd.str().size(), expected.size());
+
+        std::istringstream zstd_input(zstd.str());
+        ASSERT_TRUE(reader.parse(zstd_input, parsed));
+        ASSERT_EQ(writer.write(parsed), expected);
+
+        std::istringstream truncated(zstd.str().substr(0, zstd.str().size() / 2));
+        ASSERT_FALSE(reader.parse(truncated, parsed));
+    }
+
+    // the other writers compress the same way
+    for (auto compression : { NJson::noCompression, NJson::gzipCompression, NJson::zstdCompression }) {
+        bool supported = NJson::isCompressionSupported(compression);
+        std::ostringstream styled;
+        std::ostringstream parallel;
+        std::ostringstream built;
+
+        ASSERT_EQ(NJson::StyledWriter().write(value, styled, compression), supported);
+        ASSERT_EQ(NJson::ParallelWriter(4).write(value, parallel, compression), supported);
+        {
+            NJson::Builder builder(built, compression);
+
+            ASSERT_EQ(builder.isValid(), supported);
+            builder.value(value);
+            ASSERT_EQ(builder.isComplete(), supported);
+        }
+        if (!supported)
+            continue;
+
+        std::istringstream styled_input(styled.str());
+        ASSERT_TRUE(reader.parse(styled_input, parsed));
+        ASSERT_EQ(writer.write(parsed), expected);
+
+        std::istringstream parallel_input(parallel.str());
+        ASSERT_TRUE(reader.parse(parallel_input, parsed));
+        ASSERT_EQ(writer.write(parsed), expected);
+
+        std::istringstream built_input(built.str());
+        ASSERT_TRUE(reader.parse(built_input, parsed));
+        ASSERT_EQ(writer.write(parsed), expected);
+    }
+
+    ASSERT_TRUE(reader.parseFile("test.json", parsed));
+    ASSERT_EQ(parsed["info"]["version"].asString(), "1.0");
+    ASSERT_FALSE(reader.parseFile("missing.json", parsed));
+}
+
+TEST(njsonTest, MoveValues)
+{
+    NJson::FastWriter writer;
+    NJson::Value a;
+    NJson::Value b;
+
+    a["name"] = "a";
+    b[0] = 1;
+
+    NJson::Value moved(std::move(a));
+    ASSERT_TRUE(a.isNull());
+    a = 3;
+    ASSERT_EQ(a.asInt(), 3);
+    ASSERT_EQ(writer.write(moved), "{\"name\":\"a\"}");
+
+    std::swap(moved, b);
+    ASSERT_EQ(writer.write(moved), "[1]");
+    ASSERT_EQ(writer.write(b), "{\"name\":\"a\"}");
+
+    // a view keeps writing into its tree
+    NJson::Value root;
+    root["child"] = std::move(b);
+    ASSERT_EQ(writer.write(root), "{\"child\":{\"name\":\"a\"}}");
+    NJson::Value child = root["child"];
+    NJson::Value five;
+    five = 5;
+    child = std::move(five);
+    ASSERT_EQ(writer.write(root), "{\"child\":5}");
+
+    std::vector<NJson::Value> values;
+    for (int i = 0; i < 4; i++) {
+        NJson::Value value;
+        value = i;
+        values.push_back(std::move(value));
+    }
+    values.insert(values.begin() + 1, NJson::Value("inserted"));
+    values.erase(values.begin() + 3);
+    values.insert(values.begin(), values.back());
+
+    std::string written;
+    for (const auto& value : values)
+        written += writer.write(value) + " ";
+    ASSERT_EQ(written, "3 0 \"inserted\" 1 3 ");
+
+    // a moved view is a copy which outlives its tree
+    std::vector<NJson::Value> items;
+    {
+        NJson::Reader reader;
+        NJson::Value parsed;
+
+        ASSERT_TRUE(reader.parse(R"({"name":"a string longer than sixteen bytes"})", parsed));
+        items.push_back(parsed["name"]);
+        items.push_back(NJson::Value(std::move(parsed)));
+        ASSERT_TRUE(parsed.isNull());
+    }
+    ASSERT_EQ(items[0].asString(), "a string longer than sixteen bytes");
+    ASSERT_EQ(writer.write(items[1]), R"({"name":"a string longer than sixteen bytes"})");
+}